@@ -0,0 +1,159 @@
+/**
+ * @file arena.c
+ * @brief Region allocator given to the FMU instances through fmi2CallbackFunctions.
+ *
+ * fmi2CallbackFunctions.allocateMemory receives no instance, so the arena of
+ * the instance being called is bound to the calling thread with arenaBind()
+ * around the FMU calls. Each block starts with a header naming its arena:
+ * freeMemory then finds where a block comes from, whichever arena is bound.
+ *
+ * Blocks are taken from the region with a bump pointer. Freeing the last
+ * block gives its memory back, together with the freed blocks below it, so an
+ * instance created and freed again and again reuses the same memory. When the
+ * region is full, blocks come from calloc() and are counted as fallbacks.
+ *
+ * Included by main.c, before the simulation state.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_NONE SIZE_MAX
+
+// Structure to hold an arena and its statistics
+typedef struct {
+    void *region;                    // memory allocated by arenaNew()
+    unsigned char *base;             // first aligned byte of the region
+    size_t size;                     // size of the region
+    size_t used;                     // end of the last block
+    size_t top;                      // offset of the last block, ARENA_NONE if empty
+    size_t peak;                     // largest used
+    size_t nFallbacks;               // blocks that did not fit, taken from calloc()
+} Arena;
+
+// Types with the strictest alignment
+typedef union {
+    long double ld;
+    long long ll;
+    double d;
+    void *p;
+} ArenaAlign;
+
+// Header of a block, aligned for any type
+typedef union {
+    struct {
+        Arena *arena;                // arena of the block, NULL for a calloc() block
+        size_t previous;             // offset of the block below, ARENA_NONE if first
+        int freed;                   // freed, to be given back with the block above
+    } block;
+    ArenaAlign align;
+} ArenaHeader;
+
+// Arena of the FMU instance being called by this thread
+#if MICROPY_PY_THREAD
+static __thread Arena *currentArena;
+#else
+static Arena *currentArena;
+#endif
+
+/**
+ * @brief Creates an arena with a region of the given size, allocated on the C heap.
+ *
+ * @return The arena, NULL on allocation failure
+ */
+static Arena *arenaNew(size_t size) {
+    Arena *arena = (Arena*)calloc(1, sizeof(Arena));
+    if (!arena) return NULL;
+    void *region = malloc(size + 1);
+    if (!region) {
+        free(arena);
+        return NULL;
+    }
+    // Blocks are aligned like their header
+    uintptr_t misalign = (uintptr_t)region % sizeof(ArenaAlign);
+    size_t skip = misalign ? sizeof(ArenaAlign) - misalign : 0;
+    if (skip > size) skip = size;
+    arena->region = region;
+    arena->base = (unsigned char*)region + skip;
+    arena->size = size - skip;
+    arena->top = ARENA_NONE;
+    return arena;
+}
+
+/**
+ * @brief Frees an arena, its blocks must no longer be used.
+ */
+static void arenaDelete(Arena *arena) {
+    if (!arena) return;
+    free(arena->region);
+    free(arena);
+}
+
+/**
+ * @brief Binds an arena to the calling thread, NULL to use calloc() and free().
+ *
+ * @return The arena bound before, to bind again once the FMU call returns
+ */
+static Arena *arenaBind(Arena *arena) {
+    Arena *previous = currentArena;
+    currentArena = arena;
+    return previous;
+}
+
+/**
+ * @brief Drops all the blocks of an arena at once, when its instance is freed.
+ *
+ * Blocks the FMU did not free are given back too, so the next instance
+ * allocated from the arena starts from an empty region.
+ */
+static void arenaReset(Arena *arena) {
+    arena->used = 0;
+    arena->top = ARENA_NONE;
+}
+
+/**
+ * @brief allocateMemory callback: calloc() semantics, from the bound arena if it fits.
+ */
+static void *arenaAllocate(size_t nobj, size_t size) {
+    if (size != 0 && nobj > (SIZE_MAX - 2 * sizeof(ArenaHeader)) / size) return NULL;
+    size_t bytes = sizeof(ArenaHeader) + nobj * size;
+    bytes = (bytes + sizeof(ArenaHeader) - 1) / sizeof(ArenaHeader) * sizeof(ArenaHeader);
+
+    Arena *arena = currentArena;
+    ArenaHeader *header;
+    if (arena && bytes <= arena->size - arena->used) {
+        header = (ArenaHeader*)(arena->base + arena->used);
+        memset(header, 0, bytes);
+        header->block.arena = arena;
+        header->block.previous = arena->top;
+        arena->top = arena->used;
+        arena->used += bytes;
+        if (arena->used > arena->peak) arena->peak = arena->used;
+    } else {
+        header = (ArenaHeader*)calloc(1, bytes);
+        if (!header) return NULL;
+        if (arena) arena->nFallbacks++;
+        header->block.arena = NULL;
+    }
+    return header + 1;
+}
+
+/**
+ * @brief freeMemory callback, for blocks of any arena.
+ */
+static void arenaFree(void *obj) {
+    if (!obj) return;
+    ArenaHeader *header = (ArenaHeader*)obj - 1;
+    Arena *arena = header->block.arena;
+    if (!arena) {
+        free(header);
+        return;
+    }
+    header->block.freed = 1;
+    // Give back the last block and the freed ones below it
+    while (arena->top != ARENA_NONE) {
+        ArenaHeader *last = (ArenaHeader*)(arena->base + arena->top);
+        if (!last->block.freed) break;
+        arena->used = arena->top;
+        arena->top = last->block.previous;
+    }
+}
@@ -5,13 +5,24 @@
 #include "headers/fmi2TypesPlatform.h"
 #include "headers/fmi2FunctionTypes.h"
 #include "headers/fmi2Functions.h"
-#include "fmu/sources/config.h"
-#include "fmu/sources/model.h"
 
 #define CONCAT_(prefix, name) prefix##_##name
 #define CONCAT(prefix, name) CONCAT_(prefix,name)
 #define FUNCTION(name) CONCAT(MODEL_IDENTIFIER, name)
-//#define FUNCTION(name) name
+
+// Interfaces loaded into the function table, both by default.
+// Compile with -DFMI_COSIMULATION=0 or -DFMI_MODEL_EXCHANGE=0 to leave one out.
+#ifndef FMI_COSIMULATION
+#define FMI_COSIMULATION 1
+#endif
+#ifndef FMI_MODEL_EXCHANGE
+#define FMI_MODEL_EXCHANGE 1
+#endif
+
+// Loading of FMU shared libraries at run time with dlopen, set by micropython.mk on Linux
+#ifndef FMU_DLOPEN
+#define FMU_DLOPEN 0
+#endif
 
 typedef struct {
     /***************************************************
@@ -70,53 +81,131 @@ typedef struct {
 } FMU;
 
 
-static int loadFunctions(FMU *fmu) {
-    fmu->getTypesPlatform          = (fmi2GetTypesPlatformTYPE *)      fmi2GetTypesPlatform;
-    fmu->getVersion                = (fmi2GetVersionTYPE *)            fmi2GetVersion;
-    fmu->setDebugLogging           = (fmi2SetDebugLoggingTYPE *)       fmi2SetDebugLogging;
-    fmu->instantiate               = (fmi2InstantiateTYPE *)           fmi2Instantiate;
-    fmu->freeInstance              = (fmi2FreeInstanceTYPE *)          fmi2FreeInstance;
-    fmu->setupExperiment           = (fmi2SetupExperimentTYPE *)       fmi2SetupExperiment;
-    fmu->enterInitializationMode   = (fmi2EnterInitializationModeTYPE *) fmi2EnterInitializationMode;
-    fmu->exitInitializationMode    = (fmi2ExitInitializationModeTYPE *) fmi2ExitInitializationMode;
-    fmu->terminate                 = (fmi2TerminateTYPE *)             fmi2Terminate;
-    fmu->reset                     = (fmi2ResetTYPE *)                 fmi2Reset;
-    fmu->getReal                   = (fmi2GetRealTYPE *)               fmi2GetReal;
-    fmu->getInteger                = (fmi2GetIntegerTYPE *)            fmi2GetInteger;
-    fmu->getBoolean                = (fmi2GetBooleanTYPE *)            fmi2GetBoolean;
-    fmu->getString                 = (fmi2GetStringTYPE *)             fmi2GetString;
-    fmu->setReal                   = (fmi2SetRealTYPE *)               fmi2SetReal;
-    fmu->setInteger                = (fmi2SetIntegerTYPE *)            fmi2SetInteger;
-    fmu->setBoolean                = (fmi2SetBooleanTYPE *)            fmi2SetBoolean;
-    fmu->setString                 = (fmi2SetStringTYPE *)             fmi2SetString;
-    fmu->getFMUstate               = (fmi2GetFMUstateTYPE *)           fmi2GetFMUstate;
-    fmu->setFMUstate               = (fmi2SetFMUstateTYPE *)           fmi2SetFMUstate;
-    fmu->freeFMUstate              = (fmi2FreeFMUstateTYPE *)          fmi2FreeFMUstate;
-    fmu->serializedFMUstateSize    = (fmi2SerializedFMUstateSizeTYPE *) fmi2SerializedFMUstateSize;
-    fmu->serializeFMUstate         = (fmi2SerializeFMUstateTYPE *)     fmi2SerializeFMUstate;
-    fmu->deSerializeFMUstate       = (fmi2DeSerializeFMUstateTYPE *)   fmi2DeSerializeFMUstate;
-    fmu->getDirectionalDerivative  = (fmi2GetDirectionalDerivativeTYPE *) fmi2GetDirectionalDerivative;
-#ifdef FMI_COSIMULATION
-    fmu->setRealInputDerivatives   = (fmi2SetRealInputDerivativesTYPE *) fmi2SetRealInputDerivatives;
-    fmu->getRealOutputDerivatives  = (fmi2GetRealOutputDerivativesTYPE *) fmi2GetRealOutputDerivatives;
-    fmu->doStep                    = (fmi2DoStepTYPE *)                fmi2DoStep;
-    fmu->cancelStep                = (fmi2CancelStepTYPE *)            fmi2CancelStep;
-    fmu->getStatus                 = (fmi2GetStatusTYPE *)             fmi2GetStatus;
-    fmu->getRealStatus             = (fmi2GetRealStatusTYPE *)         fmi2GetRealStatus;
-    fmu->getIntegerStatus          = (fmi2GetIntegerStatusTYPE *)      fmi2GetIntegerStatus;
-    fmu->getBooleanStatus          = (fmi2GetBooleanStatusTYPE *)      fmi2GetBooleanStatus;
-    fmu->getStringStatus           = (fmi2GetStringStatusTYPE *)       fmi2GetStringStatus;
-#else // FMI2 for Model Exchange
-    fmu->enterEventMode            = (fmi2EnterEventModeTYPE *)        fmi2EnterEventMode;
-    fmu->newDiscreteStates         = (fmi2NewDiscreteStatesTYPE *)     fmi2NewDiscreteStates;
-    fmu->enterContinuousTimeMode   = (fmi2EnterContinuousTimeModeTYPE *) fmi2EnterContinuousTimeMode;
-    fmu->completedIntegratorStep   = (fmi2CompletedIntegratorStepTYPE *) fmi2CompletedIntegratorStep;
-    fmu->setTime                   = (fmi2SetTimeTYPE *)               fmi2SetTime;
-    fmu->setContinuousStates       = (fmi2SetContinuousStatesTYPE *)   fmi2SetContinuousStates;
-    fmu->getDerivatives            = (fmi2GetDerivativesTYPE *)        fmi2GetDerivatives;
-    fmu->getEventIndicators        = (fmi2GetEventIndicatorsTYPE *)    fmi2GetEventIndicators;
-    fmu->getContinuousStates       = (fmi2GetContinuousStatesTYPE *)   fmi2GetContinuousStates;
-    fmu->getNominalsOfContinuousStates = (fmi2GetNominalsOfContinuousStatesTYPE *) fmi2GetNominalsOfContinuousStates;
+// FMI functions of the function table, as X(field, name)
+#define FMI2_COMMON_FUNCTIONS(X) \
+    X(getTypesPlatform, fmi2GetTypesPlatform) \
+    X(getVersion, fmi2GetVersion) \
+    X(setDebugLogging, fmi2SetDebugLogging) \
+    X(instantiate, fmi2Instantiate) \
+    X(freeInstance, fmi2FreeInstance) \
+    X(setupExperiment, fmi2SetupExperiment) \
+    X(enterInitializationMode, fmi2EnterInitializationMode) \
+    X(exitInitializationMode, fmi2ExitInitializationMode) \
+    X(terminate, fmi2Terminate) \
+    X(reset, fmi2Reset) \
+    X(getReal, fmi2GetReal) \
+    X(getInteger, fmi2GetInteger) \
+    X(getBoolean, fmi2GetBoolean) \
+    X(getString, fmi2GetString) \
+    X(setReal, fmi2SetReal) \
+    X(setInteger, fmi2SetInteger) \
+    X(setBoolean, fmi2SetBoolean) \
+    X(setString, fmi2SetString) \
+    X(getFMUstate, fmi2GetFMUstate) \
+    X(setFMUstate, fmi2SetFMUstate) \
+    X(freeFMUstate, fmi2FreeFMUstate) \
+    X(serializedFMUstateSize, fmi2SerializedFMUstateSize) \
+    X(serializeFMUstate, fmi2SerializeFMUstate) \
+    X(deSerializeFMUstate, fmi2DeSerializeFMUstate) \
+    X(getDirectionalDerivative, fmi2GetDirectionalDerivative)
+
+#if FMI_COSIMULATION
+#define FMI2_COSIMULATION_FUNCTIONS(X) \
+    X(setRealInputDerivatives, fmi2SetRealInputDerivatives) \
+    X(getRealOutputDerivatives, fmi2GetRealOutputDerivatives) \
+    X(doStep, fmi2DoStep) \
+    X(cancelStep, fmi2CancelStep) \
+    X(getStatus, fmi2GetStatus) \
+    X(getRealStatus, fmi2GetRealStatus) \
+    X(getIntegerStatus, fmi2GetIntegerStatus) \
+    X(getBooleanStatus, fmi2GetBooleanStatus) \
+    X(getStringStatus, fmi2GetStringStatus)
+#else
+#define FMI2_COSIMULATION_FUNCTIONS(X)
+#endif
+
+#if FMI_MODEL_EXCHANGE
+#define FMI2_MODEL_EXCHANGE_FUNCTIONS(X) \
+    X(enterEventMode, fmi2EnterEventMode) \
+    X(newDiscreteStates, fmi2NewDiscreteStates) \
+    X(enterContinuousTimeMode, fmi2EnterContinuousTimeMode) \
+    X(completedIntegratorStep, fmi2CompletedIntegratorStep) \
+    X(setTime, fmi2SetTime) \
+    X(setContinuousStates, fmi2SetContinuousStates) \
+    X(getDerivatives, fmi2GetDerivatives) \
+    X(getEventIndicators, fmi2GetEventIndicators) \
+    X(getContinuousStates, fmi2GetContinuousStates) \
+    X(getNominalsOfContinuousStates, fmi2GetNominalsOfContinuousStates)
+#else
+#define FMI2_MODEL_EXCHANGE_FUNCTIONS(X)
 #endif
+
+#define FMI2_FUNCTIONS(X) FMI2_COMMON_FUNCTIONS(X) FMI2_COSIMULATION_FUNCTIONS(X) FMI2_MODEL_EXCHANGE_FUNCTIONS(X)
+
+/**
+ * @brief Checks a function table filled from an FMU that may implement only one interface.
+ *
+ * The Model Exchange interface is only usable if the whole loop is there:
+ * otherwise enterContinuousTimeMode is set to NULL.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @return 0 on success, -1 if a function common to both interfaces is missing
+ */
+static int checkFunctions(FMU *fmu) {
+#if FMI_MODEL_EXCHANGE
+    if (!fmu->enterEventMode || !fmu->newDiscreteStates || !fmu->enterContinuousTimeMode ||
+        !fmu->completedIntegratorStep || !fmu->setTime || !fmu->setContinuousStates ||
+        !fmu->getDerivatives || !fmu->getEventIndicators || !fmu->getContinuousStates) {
+        fmu->enterContinuousTimeMode = NULL;
+    }
+#endif
+
+    if (!fmu->instantiate || !fmu->freeInstance || !fmu->setupExperiment ||
+        !fmu->enterInitializationMode || !fmu->exitInitializationMode || !fmu->terminate ||
+        !fmu->getReal || !fmu->getInteger || !fmu->getBoolean ||
+        !fmu->setReal || !fmu->setInteger || !fmu->setBoolean) {
+        return -1;
+    }
     return 0;
 }
+
+// Functions of an FMU compiled into the firmware, prefixed with MODEL_IDENTIFIER_.
+// They are weak: those of an interface the FMU does not implement are NULL.
+#define DECLARE_FUNCTION(field, name) extern name##TYPE FUNCTION(name) __attribute__((weak));
+#define LOAD_FUNCTION(field, name) fmu->field = FUNCTION(name);
+
+/**
+ * @brief Defines MODEL_IDENTIFIER_loadFunctions(FMU *fmu), which fills a
+ * function table with the functions of the FMU compiled with the prefix
+ * MODEL_IDENTIFIER_, and returns checkFunctions().
+ *
+ * Used once per model by the generated modelDescription.c, with
+ * MODEL_IDENTIFIER defined to the modelIdentifier of the FMU.
+ */
+#define DEFINE_LOAD_FUNCTIONS \
+    FMI2_FUNCTIONS(DECLARE_FUNCTION) \
+    static int FUNCTION(loadFunctions)(FMU *fmu) { \
+        FMI2_FUNCTIONS(LOAD_FUNCTION) \
+        return checkFunctions(fmu); \
+    }
+
+#if FMU_DLOPEN
+#include <dlfcn.h>
+
+#define LOAD_SYMBOL(field, name) fmu->field = (name##TYPE *) dlsym(library, #name);
+
+/**
+ * @brief Fills the function table from an FMU shared library opened with dlopen.
+ *
+ * The FMU may implement only one of the interfaces: the functions of the
+ * other one are left NULL.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param library Handle returned by dlopen
+ * @return 0 on success, -1 if a function common to both interfaces is missing
+ */
+static int loadSharedFunctions(FMU *fmu, void *library) {
+    FMI2_FUNCTIONS(LOAD_SYMBOL)
+    return checkFunctions(fmu);
+}
+#endif
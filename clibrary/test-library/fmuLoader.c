@@ -0,0 +1,567 @@
+/**
+ * @file fmuLoader.c
+ * @brief Loading of FMUs at run time, on the ports where dlopen is available.
+ *
+ * A .fmu archive is extracted with the unzip tool into a temporary directory
+ * (an already extracted directory is used in place), its modelDescription.xml
+ * is parsed by xmlParser.c, the parser of genModelDescription, into the same
+ * tables as the generated modelDescription.c and the shared library
+ * binaries/<platform>/<modelIdentifier>.so is opened with dlopen.
+ *
+ * Once the library is open, the extracted files are removed unless the FMU
+ * has resources, read when it is instantiated. These are removed when the FMU
+ * is unloaded or at exit, the unix port not running the finalisers at exit.
+ *
+ * Compiled when FMU_DLOPEN is set, see micropython.mk.
+ */
+#include <dlfcn.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "xmlParser.c"
+
+#if defined(__APPLE__)
+#define FMU_PLATFORM "darwin64"
+#define FMU_LIBRARY_SUFFIX ".dylib"
+#elif defined(__x86_64__) || defined(__aarch64__)
+#define FMU_PLATFORM "linux64"
+#define FMU_LIBRARY_SUFFIX ".so"
+#else
+#define FMU_PLATFORM "linux32"
+#define FMU_LIBRARY_SUFFIX ".so"
+#endif
+
+// FMU loaded by loadFMUModel(), everything is allocated with malloc
+struct LoadedFMU {
+    FMUModel model;                  // model handed to the simulations
+    FMU fmu;                         // function table filled from the shared library
+    void *library;                   // handle returned by dlopen
+    ModelDescription description;    // strings owned by the loaded model
+    ScalarVariable *variables;       // variables, in the order of ModelVariables
+    int nVariables;                  // number of variables
+    int capacity;                    // allocated number of variables
+    int *byName;                     // indices of the variables sorted by name
+    char *modelIdentifier;           // name of the shared library
+    char *directory;                 // directory of the extracted FMU
+    int extracted;                   // the directory is temporary and removed on unload
+    struct LoadedFMU *nextExtracted; // next FMU whose extracted files are removed at exit
+    char *resourceLocation;          // file URI of the resources directory
+    int *derivatives;                // index of the derivative of each continuous state
+    char **dependencies;             // dependencies attribute of each derivative, NULL if missing
+    int derivativesCapacity;         // allocated number of derivatives
+    int *jacobianRows;               // Jacobian pattern, see buildJacobianPattern()
+    int *jacobianColumns;
+};
+
+/**
+ * @brief Returns a decoded copy of an attribute value, NULL if the element does not have it.
+ */
+static char *xmlAttribute(XmlParser *parser, const XmlAttribute *attrs, int nAttrs, const char *name) {
+    const XmlAttribute *attr = xmlFindAttribute(attrs, nAttrs, name);
+    if (!attr) return NULL;
+
+    char *value = (char*)malloc(attr->valueLen + 1);
+    if (!value) {
+        parser->error = "Out of memory";
+    } else if (xmlDecode(attr, value) != 0) {
+        parser->error = "Invalid entity in modelDescription.xml";
+        free(value);
+        value = NULL;
+    }
+    return value;
+}
+
+/**
+ * @brief Parses a start value, or a min or max, of the given type.
+ */
+static void parseVariableValue(ScalarVariable *var, const char *value, int *intValue, double *realValue) {
+    if (var->type == REAL) {
+        *realValue = strtod(value, NULL);
+    } else if (var->type == BOOLEAN) {
+        *intValue = strcmp(value, "true") == 0 || strcmp(value, "1") == 0;
+    } else {
+        *intValue = (int)strtol(value, NULL, 10);
+    }
+}
+
+/**
+ * @brief Handles an opening (or empty) element of modelDescription.xml, returns whether its children matter.
+ */
+static int modelStartElement(XmlParser *parser, const char *name, const XmlAttribute *attrs, int nAttrs) {
+    LoadedFMU *loaded = parser->context;
+    ModelDescription *md = &loaded->description;
+
+    if (strcmp(name, "fmiModelDescription") == 0 && parser->depth == 0) {
+        char *fmiVersion = xmlAttribute(parser, attrs, nAttrs, "fmiVersion");
+        md->version = fmiVersion ? atoi(fmiVersion) : 0;
+        free(fmiVersion);
+        md->modelName = xmlAttribute(parser, attrs, nAttrs, "modelName");
+        md->description = xmlAttribute(parser, attrs, nAttrs, "description");
+        md->guid = xmlAttribute(parser, attrs, nAttrs, "guid");
+        char *nz = xmlAttribute(parser, attrs, nAttrs, "numberOfEventIndicators");
+        md->numberOfEventIndicators = nz ? atoi(nz) : 0;
+        free(nz);
+        return 1;
+    } else if ((strcmp(name, "ModelExchange") == 0 || strcmp(name, "CoSimulation") == 0) &&
+               xmlInside(parser, "fmiModelDescription", NULL)) {
+        if (!loaded->modelIdentifier) {
+            loaded->modelIdentifier = xmlAttribute(parser, attrs, nAttrs, "modelIdentifier");
+        }
+        if (strcmp(name, "ModelExchange") == 0) {
+            char *value = xmlAttribute(parser, attrs, nAttrs, "providesDirectionalDerivative");
+            md->providesDirectionalDerivative = value && strcmp(value, "true") == 0;
+            free(value);
+        }
+    } else if ((strcmp(name, "ModelVariables") == 0 || strcmp(name, "ModelStructure") == 0) &&
+               xmlInside(parser, "fmiModelDescription", NULL)) {
+        return 1;
+    } else if (strcmp(name, "ScalarVariable") == 0 && xmlInside(parser, "ModelVariables", NULL)) {
+        if (loaded->nVariables == loaded->capacity) {
+            int capacity = loaded->capacity ? 2 * loaded->capacity : 64;
+            ScalarVariable *variables = (ScalarVariable*)realloc(loaded->variables, capacity * sizeof(ScalarVariable));
+            if (!variables) {
+                parser->error = "Out of memory";
+                return 0;
+            }
+            loaded->variables = variables;
+            loaded->capacity = capacity;
+        }
+        ScalarVariable *var = &loaded->variables[loaded->nVariables++];
+        memset(var, 0, sizeof(ScalarVariable));
+        var->name = xmlAttribute(parser, attrs, nAttrs, "name");
+        var->description = xmlAttribute(parser, attrs, nAttrs, "description");
+        char *vr = xmlAttribute(parser, attrs, nAttrs, "valueReference");
+        if (!var->name || !vr) {
+            parser->error = "ScalarVariable without name or valueReference";
+        } else {
+            var->valueReference = (unsigned int)strtoul(vr, NULL, 10);
+        }
+        free(vr);
+
+        char *causality = xmlAttribute(parser, attrs, nAttrs, "causality");
+        var->causality = !causality ? LOCAL :
+                         strcmp(causality, "parameter") == 0 ? PARAMETER :
+                         strcmp(causality, "calculatedParameter") == 0 ? CALCULATED_PARAMETER :
+                         strcmp(causality, "input") == 0 ? INPUT :
+                         strcmp(causality, "output") == 0 ? OUTPUT :
+                         strcmp(causality, "independent") == 0 ? INDEPENDENT : LOCAL;
+        char *variability = xmlAttribute(parser, attrs, nAttrs, "variability");
+        var->variability = !variability ? CONTINUOUS :
+                           strcmp(variability, "constant") == 0 ? CONSTANT :
+                           strcmp(variability, "fixed") == 0 ? FIXED :
+                           strcmp(variability, "tunable") == 0 ? TUNABLE :
+                           strcmp(variability, "discrete") == 0 ? DISCRETE : CONTINUOUS;
+        // Same defaults as the compiled-in models
+        char *initialAttribute = xmlAttribute(parser, attrs, nAttrs, "initial");
+        const char *initial = xmlVariableInitial(initialAttribute, causality, variability);
+        var->initial = strcmp(initial, "approx") == 0 ? APPROX : strcmp(initial, "calculated") == 0 ? CALCULATED : EXACT;
+        free(initialAttribute);
+        free(variability);
+        free(causality);
+        return 1;
+    } else if (loaded->nVariables > 0 && xmlInside(parser, "ScalarVariable", "ModelVariables")) {
+        ScalarVariable *var = &loaded->variables[loaded->nVariables - 1];
+        if (strcmp(name, "Real") == 0) var->type = REAL;
+        else if (strcmp(name, "Integer") == 0) var->type = INTEGER;
+        else if (strcmp(name, "Boolean") == 0) var->type = BOOLEAN;
+        else if (strcmp(name, "String") == 0) var->type = STRING;
+        else if (strcmp(name, "Enumeration") == 0) var->type = ENUMERATION;
+        else return 0;               // Annotations
+        var->declaredType = xmlAttribute(parser, attrs, nAttrs, "declaredType");
+
+        char *value = xmlAttribute(parser, attrs, nAttrs, "start");
+        if (value && var->type == STRING) {
+            var->start.stringValue = value;
+            value = NULL;
+        } else if (value) {
+            parseVariableValue(var, value, &var->start.intValue, &var->start.realValue);
+        }
+        free(value);
+        if (var->type != STRING && var->type != BOOLEAN) {
+            if ((value = xmlAttribute(parser, attrs, nAttrs, "min"))) {
+                parseVariableValue(var, value, &var->min.intMin, &var->min.realMin);
+                free(value);
+            }
+            if ((value = xmlAttribute(parser, attrs, nAttrs, "max"))) {
+                parseVariableValue(var, value, &var->max.intMax, &var->max.realMax);
+                free(value);
+            }
+        }
+        if ((value = xmlAttribute(parser, attrs, nAttrs, "derivative"))) {
+            var->derivative = atoi(value);
+            free(value);
+        }
+        if ((value = xmlAttribute(parser, attrs, nAttrs, "reinit"))) {
+            var->reinit = strcmp(value, "true") == 0;
+            free(value);
+        }
+    } else if (strcmp(name, "Derivatives") == 0 && xmlInside(parser, "ModelStructure", NULL)) {
+        return 1;
+    } else if (strcmp(name, "Unknown") == 0 && xmlInside(parser, "Derivatives", "ModelStructure")) {
+        int nx = md->numberOfContinuousStates;
+        if (nx == loaded->derivativesCapacity) {
+            int capacity = nx ? 2 * nx : 16;
+            int *derivatives = (int*)realloc(loaded->derivatives, capacity * sizeof(int));
+            if (derivatives) loaded->derivatives = derivatives;
+            char **dependencies = (char**)realloc(loaded->dependencies, capacity * sizeof(char*));
+            if (dependencies) loaded->dependencies = dependencies;
+            if (!derivatives || !dependencies) {
+                parser->error = "Out of memory";
+                return 0;
+            }
+            loaded->derivativesCapacity = capacity;
+        }
+        char *index = xmlAttribute(parser, attrs, nAttrs, "index");
+        loaded->derivatives[nx] = index ? atoi(index) - 1 : -1;
+        free(index);
+        loaded->dependencies[nx] = xmlAttribute(parser, attrs, nAttrs, "dependencies");
+        md->numberOfContinuousStates++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a whole file into a NUL-terminated buffer, to be freed by the caller.
+ */
+static char *readFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    char *buffer = NULL;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        if (size >= 0 && fseek(file, 0, SEEK_SET) == 0 && (buffer = (char*)malloc(size + 1))) {
+            if (fread(buffer, 1, size, file) != (size_t)size) {
+                free(buffer);
+                buffer = NULL;
+            } else {
+                buffer[size] = '\0';
+            }
+        }
+    }
+    fclose(file);
+    return buffer;
+}
+
+/**
+ * @brief Extracts a .fmu archive into a directory with the unzip tool.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int extractFMU(const char *path, const char *directory) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        // Quiet, the archive comes from the caller and is not trusted to be well-formed
+        execlp("unzip", "unzip", "-qq", "-o", path, "-d", directory, (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)) return -1;
+    // unzip returns 1 on warnings, the files are extracted
+    return WEXITSTATUS(status) <= 1 ? 0 : -1;
+}
+
+/**
+ * @brief Removes a directory and its content, without following symbolic links.
+ */
+static void removeDirectory(const char *path) {
+    DIR *dir = opendir(path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            size_t len = strlen(path) + strlen(entry->d_name) + 2;
+            char *child = (char*)malloc(len);
+            if (!child) continue;
+            snprintf(child, len, "%s/%s", path, entry->d_name);
+            struct stat st;
+            if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+                removeDirectory(child);
+            } else {
+                remove(child);
+            }
+            free(child);
+        }
+        closedir(dir);
+    }
+    remove(path);
+}
+
+// Loaded FMUs whose extracted files are kept for their resources, changed with the GIL held
+static LoadedFMU *extractedFMUs;
+
+/**
+ * @brief Removes the extracted files of the FMUs still loaded, registered with atexit().
+ */
+static void removeExtractedFMUs(void) {
+    for (LoadedFMU *loaded = extractedFMUs; loaded; loaded = loaded->nextExtracted) {
+        removeDirectory(loaded->directory);
+    }
+    extractedFMUs = NULL;
+}
+
+/**
+ * @brief Removes the extracted files of an FMU whose library is open, unless it has resources.
+ *
+ * An FMU with resources keeps its files until it is unloaded, or until exit.
+ */
+static void releaseExtractedFiles(LoadedFMU *loaded) {
+    static int registered;
+    size_t len = strlen(loaded->directory) + 16;
+    char *resources = (char*)malloc(len);
+    struct stat st;
+    if (resources) snprintf(resources, len, "%s/resources", loaded->directory);
+    if (resources && stat(resources, &st) != 0) {
+        removeDirectory(loaded->directory);
+        loaded->extracted = 0;
+    } else {
+        if (!registered) registered = atexit(removeExtractedFMUs) == 0;
+        loaded->nextExtracted = extractedFMUs;
+        extractedFMUs = loaded;
+    }
+    free(resources);
+}
+
+/**
+ * @brief Frees an FMU loaded by loadFMUModel(), removing its extracted files.
+ */
+static void unloadFMUModel(LoadedFMU *loaded) {
+    if (!loaded) return;
+    // Pooled instances are freed while their code is still loaded
+    poolFree(loaded->model.pool, &loaded->fmu);
+    warmStartFree(loaded->model.warmStart);
+    if (loaded->library) dlclose(loaded->library);
+    for (int i = 0; i < loaded->nVariables; i++) {
+        ScalarVariable *var = &loaded->variables[i];
+        free((char*)var->name);
+        free((char*)var->description);
+        free((char*)var->declaredType);
+        if (var->type == STRING) free((char*)var->start.stringValue);
+    }
+    free(loaded->variables);
+    free(loaded->byName);
+    for (int i = 0; i < loaded->description.numberOfContinuousStates; i++) {
+        free(loaded->dependencies[i]);
+    }
+    free(loaded->dependencies);
+    free(loaded->derivatives);
+    free(loaded->jacobianRows);
+    free(loaded->jacobianColumns);
+    free((char*)loaded->description.modelName);
+    free((char*)loaded->description.description);
+    free((char*)loaded->description.guid);
+    free(loaded->modelIdentifier);
+    free(loaded->resourceLocation);
+    for (LoadedFMU **p = &extractedFMUs; *p; p = &(*p)->nextExtracted) {
+        if (*p == loaded) {
+            *p = loaded->nextExtracted;
+            break;
+        }
+    }
+    if (loaded->directory) {
+        if (loaded->extracted) removeDirectory(loaded->directory);
+        free(loaded->directory);
+    }
+    free(loaded);
+}
+
+/**
+ * @brief Marks the continuous states listed by a dependencies attribute, all of them if it is missing.
+ */
+static void markDependencies(const char *p, const int *stateOf, int n, int nx, char *used) {
+    for (int j = 0; j < nx; j++) used[j] = p == NULL;
+    while (p && *p) {
+        char *end;
+        long d = strtol(p, &end, 10);
+        if (end == p) break;
+        if (d >= 1 && d <= n && stateOf[d - 1] >= 0) used[stateOf[d - 1]] = 1;
+        p = end;
+    }
+}
+
+/**
+ * @brief Builds the sparsity pattern of the state Jacobian from ModelStructure/Derivatives.
+ *
+ * Same layout as the tables of genModelDescription: row i lists the states
+ * derivative i depends on. The pattern is left NULL, and the Jacobian dense,
+ * when a derivative does not name its state.
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int buildJacobianPattern(LoadedFMU *loaded) {
+    int nx = loaded->description.numberOfContinuousStates;
+    int n = loaded->nVariables;
+    for (int i = 0; i < nx; i++) {
+        int d = loaded->derivatives[i];
+        if (d < 0 || d >= n || loaded->variables[d].derivative < 1 || loaded->variables[d].derivative > n) return 0;
+    }
+
+    int *stateOf = (int*)malloc((n + 1) * sizeof(int));
+    char *used = (char*)malloc(nx + 1);
+    loaded->jacobianRows = (int*)malloc((nx + 1) * sizeof(int));
+    if (!stateOf || !used || !loaded->jacobianRows) {
+        free(stateOf);
+        free(used);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) stateOf[i] = -1;
+    for (int i = 0; i < nx; i++) stateOf[loaded->variables[loaded->derivatives[i]].derivative - 1] = i;
+
+    // Count, then fill the rows
+    int nnz = 0;
+    for (int i = 0; i < nx; i++) {
+        markDependencies(loaded->dependencies[i], stateOf, n, nx, used);
+        for (int j = 0; j < nx; j++) nnz += used[j];
+    }
+    loaded->jacobianColumns = (int*)malloc((nnz + 1) * sizeof(int));
+    if (!loaded->jacobianColumns) {
+        free(stateOf);
+        free(used);
+        return -1;
+    }
+    nnz = 0;
+    for (int i = 0; i < nx; i++) {
+        loaded->jacobianRows[i] = nnz;
+        markDependencies(loaded->dependencies[i], stateOf, n, nx, used);
+        for (int j = 0; j < nx; j++) {
+            if (used[j]) loaded->jacobianColumns[nnz++] = j;
+        }
+    }
+    loaded->jacobianRows[nx] = nnz;
+    free(stateOf);
+    free(used);
+
+    loaded->description.derivatives = loaded->derivatives;
+    loaded->description.jacobianRows = loaded->jacobianRows;
+    loaded->description.jacobianColumns = loaded->jacobianColumns;
+    return 0;
+}
+
+// Variables being sorted by loadFMUModel(), qsort has no context argument
+static const ScalarVariable *sortedVariables;
+
+static int compareVariableNames(const void *a, const void *b) {
+    return strcmp(sortedVariables[*(const int*)a].name, sortedVariables[*(const int*)b].name);
+}
+
+/**
+ * @brief Loads an FMU at run time.
+ *
+ * @param path Path of a .fmu archive, or of the directory it was extracted to
+ * @param error Set to a description of the error on failure
+ * @return The loaded FMU, whose model has a reference count of 1 and is
+ *         freed with unloadFMUModel(), or NULL on failure
+ */
+static LoadedFMU *loadFMUModel(const char *path, const char **error) {
+    LoadedFMU *loaded = (LoadedFMU*)calloc(1, sizeof(LoadedFMU));
+    if (!loaded) {
+        *error = "Out of memory";
+        return NULL;
+    }
+
+    // Directory of the FMU, extracted into a temporary directory if needed
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        *error = "FMU not found";
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        loaded->directory = realpath(path, NULL);
+    } else {
+        char temp[] = "/tmp/fmuXXXXXX";
+        if (mkdtemp(temp)) {
+            loaded->directory = strdup(temp);
+            loaded->extracted = 1;
+            if (loaded->directory && extractFMU(path, loaded->directory) < 0) {
+                *error = "Failed to extract the FMU";
+                unloadFMUModel(loaded);
+                return NULL;
+            }
+        }
+    }
+    if (!loaded->directory) {
+        *error = "Failed to create the FMU directory";
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+
+    // Model description
+    size_t dirLen = strlen(loaded->directory);
+    char *file = (char*)malloc(dirLen + 64 + 1);
+    if (!file) {
+        *error = "Out of memory";
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+    snprintf(file, dirLen + 64 + 1, "%s/modelDescription.xml", loaded->directory);
+    char *xml = readFile(file);
+    free(file);
+    if (!xml) {
+        *error = "Failed to read modelDescription.xml";
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+    XmlParser parser;
+    xmlInit(&parser, modelStartElement, loaded);
+    *error = xmlParse(&parser, xml);
+    free(xml);
+    if (!*error && loaded->description.version != 2) {
+        *error = "Only FMI 2.0 FMUs are supported";
+    } else if (!*error && (!loaded->modelIdentifier || !loaded->description.guid)) {
+        *error = "modelDescription.xml has no modelIdentifier or guid";
+    }
+    if (!*error && buildJacobianPattern(loaded) < 0) {
+        *error = "Out of memory";
+    }
+    if (*error) {
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+
+    // Variables sorted by name, for the lookups by name
+    loaded->byName = (int*)malloc((loaded->nVariables + 1) * sizeof(int));
+    size_t libLen = dirLen + strlen(loaded->modelIdentifier) + 64;
+    char *library = (char*)malloc(libLen);
+    loaded->resourceLocation = (char*)malloc(dirLen + 32);
+    if (!loaded->byName || !library || !loaded->resourceLocation) {
+        free(library);
+        *error = "Out of memory";
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+    for (int i = 0; i < loaded->nVariables; i++) {
+        loaded->byName[i] = i;
+    }
+    sortedVariables = loaded->variables;
+    qsort(loaded->byName, loaded->nVariables, sizeof(int), compareVariableNames);
+    snprintf(loaded->resourceLocation, dirLen + 32, "file://%s/resources", loaded->directory);
+
+    // Shared library
+    snprintf(library, libLen, "%s/binaries/" FMU_PLATFORM "/%s" FMU_LIBRARY_SUFFIX,
+             loaded->directory, loaded->modelIdentifier);
+    loaded->library = dlopen(library, RTLD_NOW | RTLD_LOCAL);
+    free(library);
+    if (!loaded->library) {
+        *error = "Failed to open the shared library of the FMU";
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+    if (loadSharedFunctions(&loaded->fmu, loaded->library) < 0) {
+        *error = "The shared library of the FMU does not export the FMI 2.0 functions";
+        unloadFMUModel(loaded);
+        return NULL;
+    }
+    if (loaded->extracted) releaseExtractedFiles(loaded);
+
+    loaded->model.fmu = &loaded->fmu;
+    loaded->model.description = &loaded->description;
+    loaded->model.variables = loaded->variables;
+    loaded->model.nVariables = loaded->nVariables;
+    loaded->model.byName = loaded->byName;
+    loaded->model.resourceLocation = loaded->resourceLocation;
+    loaded->model.loaded = loaded;
+    loaded->model.refCount = 1;
+    return loaded;
+}
@@ -0,0 +1,764 @@
+/**
+ * @file genModelDescription.c
+ * @brief Host tool generating modelDescription.c from the modelDescription.xml of the FMUs.
+ *
+ * Each XML file is read in a single pass by the parser of xmlParser.c, shared
+ * with load_fmu(), and the generated file holds, for each model, with names prefixed by its
+ * modelIdentifier:
+ * - the ModelDescription of the model (name, GUID, event indicators, states),
+ * - a const table of the ScalarVariables, in the order of ModelVariables,
+ * - the indices of the variables sorted by name and a perfect hash table of their names,
+ * - the indices of the continuous states and of their derivatives, taken from
+ *   ModelStructure/Derivatives,
+ * - the sparsity pattern of the state Jacobian, one row per derivative listing
+ *   the states of its dependencies attribute (all of them when it is missing),
+ * - the function <modelIdentifier>_loadFunctions(), defined by the
+ *   DEFINE_LOAD_FUNCTIONS macro of fmi2.c,
+ * and the compiledModels registry of all the models, the first one being the
+ * default model.
+ *
+ * Usage: genModelDescription fmu/A/modelDescription.xml [fmu/B/modelDescription.xml ...] modelDescription.c
+ *
+ * Built and run by the "prepare" target of the Makefile, it only depends on
+ * the C standard library.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+typedef enum { INTEGER, REAL, BOOLEAN, STRING, ENUMERATION } VarType;
+
+// Variable read from a ScalarVariable element, attributes are kept as strings
+typedef struct {
+    char *name;
+    char *valueReference;
+    char *causality;
+    char *variability;
+    char *initial;
+    char *description;
+    VarType type;
+    int hasType;                     // a type element has been read
+    char *declaredType;
+    char *start;
+    char *min;
+    char *max;
+    char *derivative;
+    char *reinit;
+} Variable;
+
+// State of the generator while the XML file is parsed
+typedef struct {
+    char *fmiVersion;
+    char *modelIdentifier;           // prefix of the FMI functions, from ModelExchange or CoSimulation
+    char *modelName;
+    char *description;
+    char *guid;
+    char *numberOfEventIndicators;
+    Variable *variables;
+    int nVariables;
+    int capacity;
+    int *derivatives;                // 1-based indices of the ModelStructure/Derivatives unknowns
+    char **dependencies;             // dependencies attribute of each derivative, NULL if missing
+    int nDerivatives;
+    int derivativesCapacity;
+    char *providesDirectionalDerivative; // attribute of ModelExchange
+} Generator;
+
+static const char *xmlFile;
+static int xmlLine = 1;
+
+/**
+ * @brief Prints an error about the XML file and exits.
+ */
+static void fail(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%s:%d: ", xmlFile, xmlLine);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    exit(1);
+}
+
+static void *xrealloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (!ptr) fail("out of memory");
+    return ptr;
+}
+
+#include "xmlParser.c"
+
+/**
+ * @brief Returns a decoded copy of an attribute value, NULL if the element does not have it.
+ *
+ * The value is handed over to the caller, which must free it.
+ */
+static char *copyAttribute(const XmlAttribute *attrs, int nAttrs, const char *name) {
+    const XmlAttribute *attr = xmlFindAttribute(attrs, nAttrs, name);
+    if (!attr) return NULL;
+    char *value = xrealloc(NULL, attr->valueLen + 1);
+    if (xmlDecode(attr, value) != 0) fail("invalid entity in %s=\"%.*s\"", name, (int)attr->valueLen, attr->value);
+    return value;
+}
+
+/**
+ * @brief Handles an opening (or empty) element, returns whether its children matter.
+ */
+static int startElement(XmlParser *parser, const char *name, const XmlAttribute *attrs, int nAttrs) {
+    Generator *gen = parser->context;
+    xmlLine = parser->line;
+    if (strcmp(name, "fmiModelDescription") == 0 && parser->depth == 0) {
+        gen->fmiVersion = copyAttribute(attrs, nAttrs, "fmiVersion");
+        gen->modelName = copyAttribute(attrs, nAttrs, "modelName");
+        gen->description = copyAttribute(attrs, nAttrs, "description");
+        gen->guid = copyAttribute(attrs, nAttrs, "guid");
+        gen->numberOfEventIndicators = copyAttribute(attrs, nAttrs, "numberOfEventIndicators");
+        return 1;
+    } else if ((strcmp(name, "ModelExchange") == 0 || strcmp(name, "CoSimulation") == 0) &&
+               xmlInside(parser, "fmiModelDescription", NULL)) {
+        if (!gen->modelIdentifier) gen->modelIdentifier = copyAttribute(attrs, nAttrs, "modelIdentifier");
+        if (strcmp(name, "ModelExchange") == 0) {
+            gen->providesDirectionalDerivative = copyAttribute(attrs, nAttrs, "providesDirectionalDerivative");
+        }
+    } else if ((strcmp(name, "ModelVariables") == 0 || strcmp(name, "ModelStructure") == 0) &&
+               xmlInside(parser, "fmiModelDescription", NULL)) {
+        return 1;
+    } else if (strcmp(name, "ScalarVariable") == 0 && xmlInside(parser, "ModelVariables", NULL)) {
+        if (gen->nVariables == gen->capacity) {
+            gen->capacity = gen->capacity ? 2 * gen->capacity : 64;
+            gen->variables = xrealloc(gen->variables, gen->capacity * sizeof(Variable));
+        }
+        Variable *var = &gen->variables[gen->nVariables++];
+        memset(var, 0, sizeof(Variable));
+        var->name = copyAttribute(attrs, nAttrs, "name");
+        var->valueReference = copyAttribute(attrs, nAttrs, "valueReference");
+        var->causality = copyAttribute(attrs, nAttrs, "causality");
+        var->variability = copyAttribute(attrs, nAttrs, "variability");
+        var->initial = copyAttribute(attrs, nAttrs, "initial");
+        var->description = copyAttribute(attrs, nAttrs, "description");
+        if (!var->name || !var->valueReference) fail("ScalarVariable without name or valueReference");
+        return 1;
+    } else if (xmlInside(parser, "ScalarVariable", "ModelVariables")) {
+        Variable *var = &gen->variables[gen->nVariables - 1];
+        if (strcmp(name, "Real") == 0) var->type = REAL;
+        else if (strcmp(name, "Integer") == 0) var->type = INTEGER;
+        else if (strcmp(name, "Boolean") == 0) var->type = BOOLEAN;
+        else if (strcmp(name, "String") == 0) var->type = STRING;
+        else if (strcmp(name, "Enumeration") == 0) var->type = ENUMERATION;
+        else return 0;               // Annotations
+        var->hasType = 1;
+        var->declaredType = copyAttribute(attrs, nAttrs, "declaredType");
+        var->start = copyAttribute(attrs, nAttrs, "start");
+        var->min = copyAttribute(attrs, nAttrs, "min");
+        var->max = copyAttribute(attrs, nAttrs, "max");
+        var->derivative = copyAttribute(attrs, nAttrs, "derivative");
+        var->reinit = copyAttribute(attrs, nAttrs, "reinit");
+    } else if (strcmp(name, "Derivatives") == 0 && xmlInside(parser, "ModelStructure", NULL)) {
+        return 1;
+    } else if (strcmp(name, "Unknown") == 0 && xmlInside(parser, "Derivatives", "ModelStructure")) {
+        char *index = copyAttribute(attrs, nAttrs, "index");
+        if (!index) fail("Unknown without index");
+        if (gen->nDerivatives == gen->derivativesCapacity) {
+            gen->derivativesCapacity = gen->derivativesCapacity ? 2 * gen->derivativesCapacity : 16;
+            gen->derivatives = xrealloc(gen->derivatives, gen->derivativesCapacity * sizeof(int));
+            gen->dependencies = xrealloc(gen->dependencies, gen->derivativesCapacity * sizeof(char*));
+        }
+        gen->dependencies[gen->nDerivatives] = copyAttribute(attrs, nAttrs, "dependencies");
+        gen->derivatives[gen->nDerivatives++] = atoi(index);
+        free(index);
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes a string as a C string literal, or NULL.
+ */
+static void writeString(FILE *out, const char *s) {
+    if (!s) {
+        fputs("NULL", out);
+        return;
+    }
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c == '\n') fputs("\\n", out);
+        else if (c < 0x20 || c == 0x7F) fprintf(out, "\\%03o", c);
+        else if (c == '?') fputs("\\?", out); // avoid trigraphs
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief Writes a numeric attribute as a C literal of the type of the variable.
+ */
+static void writeNumber(FILE *out, const char *value, VarType type) {
+    char *end;
+    if (type == REAL) {
+        double d = strtod(value, &end);
+        if (end == value) fail("invalid Real value \"%s\"", value);
+        // Shortest representation that reads back as the same double
+        char buffer[32];
+        for (int precision = 15; precision <= 17; precision++) {
+            snprintf(buffer, sizeof(buffer), "%.*g", precision, d);
+            if (strtod(buffer, NULL) == d) break;
+        }
+        fputs(buffer, out);
+    } else {
+        long l = strtol(value, &end, 10);
+        if (end == value) fail("invalid Integer value \"%s\"", value);
+        fprintf(out, "%ld", l);
+    }
+}
+
+static const char *causalityEnum(const char *causality) {
+    if (!causality) return "LOCAL";
+    if (strcmp(causality, "independent") == 0) return "INDEPENDENT";
+    if (strcmp(causality, "parameter") == 0) return "PARAMETER";
+    if (strcmp(causality, "calculatedParameter") == 0) return "CALCULATED_PARAMETER";
+    if (strcmp(causality, "input") == 0) return "INPUT";
+    if (strcmp(causality, "output") == 0) return "OUTPUT";
+    return "LOCAL";
+}
+
+static const char *variabilityEnum(const char *variability) {
+    if (!variability) return "CONTINUOUS";
+    if (strcmp(variability, "constant") == 0) return "CONSTANT";
+    if (strcmp(variability, "fixed") == 0) return "FIXED";
+    if (strcmp(variability, "tunable") == 0) return "TUNABLE";
+    if (strcmp(variability, "discrete") == 0) return "DISCRETE";
+    return "CONTINUOUS";
+}
+
+/**
+ * @brief Returns the initial attribute, or its default value from the FMI 2.0 standard.
+ */
+static const char *initialEnum(const Variable *var) {
+    const char *initial = xmlVariableInitial(var->initial, var->causality, var->variability);
+    return strcmp(initial, "approx") == 0 ? "APPROX" : strcmp(initial, "calculated") == 0 ? "CALCULATED" : "EXACT";
+}
+
+static const char *typeEnum(VarType type) {
+    switch (type) {
+        case INTEGER: return "INTEGER";
+        case BOOLEAN: return "BOOLEAN";
+        case STRING: return "STRING";
+        case ENUMERATION: return "ENUMERATION";
+        default: return "REAL";
+    }
+}
+
+// Seeded FNV-1a hash of a variable name, also emitted in the generated file
+#define HASH_FUNCTION \
+    "unsigned int hash_variable_name(unsigned int seed, const char *name) {\n" \
+    "    unsigned int h = 2166136261u ^ (seed * 2654435769u);\n" \
+    "    for (; *name; name++) {\n" \
+    "        h = (h ^ (unsigned char)*name) * 16777619u;\n" \
+    "    }\n" \
+    "    h ^= h >> 16;\n" \
+    "    h *= 0x45d9f3bu;\n" \
+    "    return h ^ (h >> 16);\n" \
+    "}\n"
+
+static unsigned int hashName(unsigned int seed, const char *name) {
+    unsigned int h = 2166136261u ^ (seed * 2654435769u);
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x45d9f3bu;
+    return h ^ (h >> 16);
+}
+
+// Perfect hash of the variable names, built by hash and displace
+typedef struct {
+    unsigned int size;               // number of slots, a power of two
+    unsigned int nBuckets;           // number of buckets, a power of two
+    int *table;                      // index + 1 of the variable of each slot, 0 for an empty slot
+    int *displacement;               // seed of each bucket, or -slot-1 for a bucket of one variable
+} PerfectHash;
+
+static const int *bucketSizes;
+
+static int compareBucketSizes(const void *a, const void *b) {
+    return bucketSizes[*(const int *)b] - bucketSizes[*(const int *)a];
+}
+
+#define MAX_DISPLACEMENT 100000
+
+/**
+ * @brief Builds a collision-free hash table of the variable names.
+ *
+ * The names are first spread in buckets with the seed 0. Starting from the
+ * largest bucket, a seed is searched for each bucket so that its names land
+ * in free slots; buckets of a single name directly take a free slot. A lookup
+ * then costs two hashes and one strcmp, whatever the number of variables.
+ */
+static void buildPerfectHash(const Generator *gen, PerfectHash *ph) {
+    int n = gen->nVariables;
+    ph->size = 8;
+    while (ph->size < (unsigned int)n) ph->size *= 2;
+
+    for (;;) {
+        ph->nBuckets = ph->size / 4;
+        ph->table = xrealloc(NULL, ph->size * sizeof(int));
+        ph->displacement = xrealloc(NULL, ph->nBuckets * sizeof(int));
+        memset(ph->table, 0, ph->size * sizeof(int));
+        memset(ph->displacement, 0, ph->nBuckets * sizeof(int));
+
+        // Variables grouped by bucket, buckets sorted by decreasing size
+        int *sizes = xrealloc(NULL, ph->nBuckets * sizeof(int));
+        int *first = xrealloc(NULL, (ph->nBuckets + 1) * sizeof(int));
+        int *byBucket = xrealloc(NULL, (n + 1) * sizeof(int));
+        memset(sizes, 0, ph->nBuckets * sizeof(int));
+        for (int i = 0; i < n; i++) sizes[hashName(0, gen->variables[i].name) & (ph->nBuckets - 1)]++;
+        first[0] = 0;
+        for (unsigned int b = 0; b < ph->nBuckets; b++) first[b + 1] = first[b] + sizes[b];
+        memset(sizes, 0, ph->nBuckets * sizeof(int));
+        for (int i = 0; i < n; i++) {
+            unsigned int b = hashName(0, gen->variables[i].name) & (ph->nBuckets - 1);
+            byBucket[first[b] + sizes[b]++] = i;
+        }
+        int *order = xrealloc(NULL, ph->nBuckets * sizeof(int));
+        for (unsigned int b = 0; b < ph->nBuckets; b++) order[b] = b;
+        bucketSizes = sizes;
+        qsort(order, ph->nBuckets, sizeof(int), compareBucketSizes);
+
+        unsigned int *slots = xrealloc(NULL, (n + 1) * sizeof(unsigned int));
+        unsigned int freeSlot = 0;
+        int failed = 0;
+        for (unsigned int k = 0; k < ph->nBuckets && !failed; k++) {
+            int b = order[k];
+            int nMembers = sizes[b];
+            const int *members = &byBucket[first[b]];
+            if (nMembers == 0) continue;
+
+            if (nMembers == 1) {
+                while (ph->table[freeSlot]) freeSlot++;
+                ph->table[freeSlot] = members[0] + 1;
+                ph->displacement[b] = -(int)freeSlot - 1;
+                continue;
+            }
+
+            int d;
+            for (d = 1; d < MAX_DISPLACEMENT; d++) {
+                int ok = 1;
+                for (int j = 0; j < nMembers && ok; j++) {
+                    slots[j] = hashName(d, gen->variables[members[j]].name) & (ph->size - 1);
+                    if (ph->table[slots[j]]) ok = 0;
+                    for (int l = 0; l < j && ok; l++) {
+                        if (slots[l] == slots[j]) ok = 0;
+                    }
+                }
+                if (ok) break;
+            }
+            if (d == MAX_DISPLACEMENT) {
+                failed = 1;
+                break;
+            }
+            for (int j = 0; j < nMembers; j++) ph->table[slots[j]] = members[j] + 1;
+            ph->displacement[b] = d;
+        }
+        free(sizes);
+        free(first);
+        free(byBucket);
+        free(order);
+        free(slots);
+        if (!failed) return;
+
+        // Retry with more room
+        free(ph->table);
+        free(ph->displacement);
+        ph->size *= 2;
+    }
+}
+
+static const Generator *sortedGen;
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(sortedGen->variables[*(const int *)a].name,
+                  sortedGen->variables[*(const int *)b].name);
+}
+
+/**
+ * @brief Writes the value of start, min or max in the union of the variable type.
+ *
+ * @param field "start", "min" or "max"
+ * @param suffix Suffix of the union members: "Value" for start, "Min" or "Max"
+ */
+static void writeValue(FILE *out, const char *field, const char *suffix, const Variable *var, const char *value) {
+    if (!value) return;
+    fprintf(out, ", .%s = { ", field);
+    switch (var->type) {
+        case REAL:
+            fprintf(out, ".real%s = ", suffix);
+            writeNumber(out, value, REAL);
+            break;
+        case BOOLEAN:
+            fprintf(out, ".boolValue = %d", strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+            break;
+        case STRING:
+            fprintf(out, ".stringValue = ");
+            writeString(out, value);
+            break;
+        default:
+            fprintf(out, ".int%s = ", suffix);
+            writeNumber(out, value, INTEGER);
+            break;
+    }
+    fprintf(out, " }");
+}
+
+/**
+ * @brief Writes the part of modelDescription.c common to all the models.
+ */
+static void generateHeader(FILE *out, char **xmlFiles, int nModels) {
+    fprintf(out, "// Generated by genModelDescription from");
+    for (int m = 0; m < nModels; m++) fprintf(out, "%s %s", m ? "," : "", xmlFiles[m]);
+    fprintf(out, ", do not edit.\n");
+    fprintf(out,
+        "#include <stdio.h>\n"
+        "#include <stdlib.h>\n"
+        "#include <string.h>\n"
+        "\n"
+        "typedef enum { INTEGER, REAL, BOOLEAN, STRING, ENUMERATION } VarType;\n"
+        "typedef enum { INDEPENDENT, PARAMETER, CALCULATED_PARAMETER, INPUT, OUTPUT, LOCAL } Causality;\n"
+        "typedef enum { CONSTANT, FIXED, TUNABLE, DISCRETE, CONTINUOUS } Variability;\n"
+        "typedef enum { EXACT, APPROX, CALCULATED } Initial;\n"
+        "\n"
+        "typedef struct {\n"
+        "    int version;\n"
+        "    const char *modelName;\n"
+        "    const char *description;\n"
+        "    const char *guid;\n"
+        "    int numberOfEventIndicators;\n"
+        "    int numberOfContinuousStates;\n"
+        "    int providesDirectionalDerivative; // fmi2GetDirectionalDerivative can be called in Model Exchange\n"
+        "    const int *derivatives;          // index of the derivative of each continuous state, NULL if unknown\n"
+        "    const int *jacobianRows;         // start of the states of each derivative in jacobianColumns, NULL if unknown\n"
+        "    const int *jacobianColumns;      // continuous states each derivative depends on\n"
+        "} ModelDescription;\n"
+        "\n"
+        "typedef struct {\n"
+        "    const char *name;\n"
+        "    unsigned int valueReference;\n"
+        "    Causality causality;\n"
+        "    Variability variability;\n"
+        "    Initial initial;\n"
+        "    const char *description;\n"
+        "    VarType type;\n"
+        "    const char *declaredType;        // name of the SimpleType, NULL if none\n"
+        "    int derivative;                  // index + 1 of the state this variable is the derivative of, 0 otherwise\n"
+        "    int reinit;                      // the state can be reinitialized at events\n"
+        "    union {\n"
+        "        int intValue;\n"
+        "        double realValue;\n"
+        "        int boolValue;\n"
+        "        const char *stringValue;\n"
+        "    } start;\n"
+        "    union {\n"
+        "        int intMin;\n"
+        "        double realMin;\n"
+        "    } min;\n"
+        "    union {\n"
+        "        int intMax;\n"
+        "        double realMax;\n"
+        "    } max;\n"
+        "} ScalarVariable;\n"
+        "\n"
+        "// Model compiled into the firmware\n"
+        "typedef struct {\n"
+        "    const char *modelIdentifier;     // prefix of its FMI functions\n"
+        "    const ModelDescription *description;\n"
+        "    const ScalarVariable *variables; // variables, in the order of ModelVariables\n"
+        "    int nVariables;                  // number of variables\n"
+        "    int (*findVariable)(const char *name); // index of a variable, -1 if there is none\n"
+        "    int (*loadFunctions)(FMU *fmu);  // fills a function table with its FMI functions\n"
+        "} CompiledModel;\n"
+        "\n"
+        "/**\n"
+        " * @brief Seeded FNV-1a hash of a variable name, used by the find_variable() functions.\n"
+        " */\n"
+        HASH_FUNCTION
+        "\n");
+}
+
+/**
+ * @brief Writes the tables and functions of one model, prefixed by its modelIdentifier.
+ */
+static void generateModel(const Generator *gen, FILE *out) {
+    int n = gen->nVariables;
+    const char *id = gen->modelIdentifier;
+
+    // Continuous states and derivatives
+    int *states = xrealloc(NULL, (gen->nDerivatives + 1) * sizeof(int));
+    for (int i = 0; i < gen->nDerivatives; i++) {
+        int d = gen->derivatives[i] - 1;
+        if (d < 0 || d >= n || !gen->variables[d].derivative) {
+            fail("ModelStructure/Derivatives: variable %d is not a derivative", d + 1);
+        }
+        states[i] = atoi(gen->variables[d].derivative) - 1;
+        if (states[i] < 0 || states[i] >= n) {
+            fail("derivative of %s: invalid state index", gen->variables[d].name);
+        }
+    }
+
+    // Jacobian pattern: the dependencies of each derivative which are continuous states
+    int nx = gen->nDerivatives;
+    int *stateOf = xrealloc(NULL, (n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) stateOf[i] = -1;
+    for (int i = 0; i < nx; i++) stateOf[states[i]] = i;
+    int *rows = xrealloc(NULL, (nx + 1) * sizeof(int));
+    int *columns = NULL;
+    int nnz = 0, capacity = 0;
+    for (int i = 0; i < nx; i++) {
+        rows[i] = nnz;
+        char *used = xrealloc(NULL, nx + 1);
+        const char *p = gen->dependencies[i];
+        for (int j = 0; j < nx; j++) used[j] = p == NULL;
+        while (p && *p) {
+            char *end;
+            long d = strtol(p, &end, 10);
+            if (end == p) break;
+            if (d >= 1 && d <= n && stateOf[d - 1] >= 0) used[stateOf[d - 1]] = 1;
+            p = end;
+        }
+        for (int j = 0; j < nx; j++) {
+            if (!used[j]) continue;
+            if (nnz == capacity) {
+                capacity = capacity ? 2 * capacity : 16;
+                columns = xrealloc(columns, capacity * sizeof(int));
+            }
+            columns[nnz++] = j;
+        }
+        free(used);
+    }
+    rows[nx] = nnz;
+
+    PerfectHash ph;
+    buildPerfectHash(gen, &ph);
+
+    fprintf(out, "/* %s */\n\n", id);
+
+    // Continuous states
+    fprintf(out, "// Index of each continuous state and of its derivative, -1 terminated\n");
+    fprintf(out, "const int %s_states[%d] = { ", id, gen->nDerivatives + 1);
+    for (int i = 0; i < gen->nDerivatives; i++) fprintf(out, "%d, ", states[i]);
+    fprintf(out, "-1 };\n");
+    fprintf(out, "const int %s_derivatives[%d] = { ", id, gen->nDerivatives + 1);
+    for (int i = 0; i < gen->nDerivatives; i++) fprintf(out, "%d, ", gen->derivatives[i] - 1);
+    fprintf(out, "-1 };\n\n");
+
+    // Jacobian pattern
+    fprintf(out, "// States each derivative depends on: row i is jacobianColumns[jacobianRows[i]..jacobianRows[i+1]-1]\n");
+    fprintf(out, "const int %s_jacobianRows[%d] = { ", id, nx + 1);
+    for (int i = 0; i <= nx; i++) fprintf(out, "%s%d", i ? ", " : "", rows[i]);
+    fprintf(out, " };\n");
+    fprintf(out, "const int %s_jacobianColumns[%d] = { ", id, nnz + 1);
+    for (int k = 0; k < nnz; k++) fprintf(out, "%d, ", columns[k]);
+    fprintf(out, "-1 };\n\n");
+
+    fprintf(out, "const ModelDescription %s_description = {\n", id);
+    fprintf(out, "    .version = %d,\n", gen->fmiVersion ? atoi(gen->fmiVersion) : 2);
+    fprintf(out, "    .modelName = ");
+    writeString(out, gen->modelName);
+    fprintf(out, ",\n    .description = ");
+    writeString(out, gen->description);
+    fprintf(out, ",\n    .guid = ");
+    writeString(out, gen->guid);
+    fprintf(out, ",\n    .numberOfEventIndicators = %d,\n",
+            gen->numberOfEventIndicators ? atoi(gen->numberOfEventIndicators) : 0);
+    fprintf(out, "    .numberOfContinuousStates = %d,\n", gen->nDerivatives);
+    fprintf(out, "    .providesDirectionalDerivative = %d,\n",
+            gen->providesDirectionalDerivative && strcmp(gen->providesDirectionalDerivative, "true") == 0);
+    fprintf(out, "    .derivatives = %s_derivatives,\n", id);
+    fprintf(out, "    .jacobianRows = %s_jacobianRows,\n", id);
+    fprintf(out, "    .jacobianColumns = %s_jacobianColumns\n};\n\n", id);
+
+    // Variables, in the order of ModelVariables
+    fprintf(out, "// Variables of the model, in the order of ModelVariables\n");
+    fprintf(out, "static const ScalarVariable %s_variables[%d] = {\n", id, n);
+    for (int i = 0; i < n; i++) {
+        const Variable *var = &gen->variables[i];
+        if (!var->hasType) fail("ScalarVariable %s has no type", var->name);
+        fprintf(out, "    { .name = ");
+        writeString(out, var->name);
+        fprintf(out, ", .valueReference = %lu", strtoul(var->valueReference, NULL, 10));
+        fprintf(out, ", .causality = %s, .variability = %s, .initial = %s",
+                causalityEnum(var->causality), variabilityEnum(var->variability), initialEnum(var));
+        fprintf(out, ",\n      .description = ");
+        writeString(out, var->description ? var->description : "");
+        fprintf(out, ", .type = %s", typeEnum(var->type));
+        if (var->declaredType) {
+            fprintf(out, ", .declaredType = ");
+            writeString(out, var->declaredType);
+        }
+        if (var->derivative) fprintf(out, ", .derivative = %d", atoi(var->derivative));
+        if (var->reinit && strcmp(var->reinit, "true") == 0) fprintf(out, ", .reinit = 1");
+        writeValue(out, "start", "Value", var, var->start);
+        if (var->type != BOOLEAN && var->type != STRING) {
+            writeValue(out, "min", "Min", var, var->min);
+            writeValue(out, "max", "Max", var, var->max);
+        }
+        fprintf(out, " },\n");
+    }
+    fprintf(out, "};\n\n");
+
+    // Indices sorted by name
+    int *sorted = xrealloc(NULL, (n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) sorted[i] = i;
+    sortedGen = gen;
+    qsort(sorted, n, sizeof(int), compareNames);
+    for (int i = 1; i < n; i++) {
+        if (strcmp(gen->variables[sorted[i]].name, gen->variables[sorted[i - 1]].name) == 0) {
+            fail("duplicate variable name %s", gen->variables[sorted[i]].name);
+        }
+    }
+    fprintf(out, "// Indices of the variables sorted by name\n");
+    fprintf(out, "const int %s_variablesByName[%d] = {", id, n);
+    for (int i = 0; i < n; i++) fprintf(out, "%s%d", i == 0 ? "\n    " : i % 16 ? ", " : ",\n    ", sorted[i]);
+    fprintf(out, "\n};\n\n");
+
+    // Perfect hash of the names
+    fprintf(out, "// Seed of each bucket of names, or -slot-1 for a bucket holding a single name\n");
+    fprintf(out, "const int %s_variableDisplacement[%u] = {", id, ph.nBuckets);
+    for (unsigned int i = 0; i < ph.nBuckets; i++) fprintf(out, "%s%d", i == 0 ? "\n    " : i % 16 ? ", " : ",\n    ", ph.displacement[i]);
+    fprintf(out, "\n};\n\n");
+    fprintf(out, "// Index + 1 of the variable whose name hashes to each slot, 0 for an empty slot\n");
+    fprintf(out, "const int %s_variableHash[%u] = {", id, ph.size);
+    for (unsigned int i = 0; i < ph.size; i++) fprintf(out, "%s%d", i == 0 ? "\n    " : i % 16 ? ", " : ",\n    ", ph.table[i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out,
+        "/**\n"
+        " * @brief Returns the index of the variable of %s with the given name, -1 if there is none.\n"
+        " *\n"
+        " * The hash is perfect: a single slot is checked, whatever the number of variables.\n"
+        " */\n"
+        "int %s_find_variable(const char *name) {\n"
+        "    int d = %s_variableDisplacement[hash_variable_name(0, name) & %u];\n"
+        "    unsigned int slot = d < 0 ? (unsigned int)(-d - 1) : hash_variable_name(d, name) & %u;\n"
+        "    int i = %s_variableHash[slot] - 1;\n"
+        "    return i >= 0 && strcmp(%s_variables[i].name, name) == 0 ? i : -1;\n"
+        "}\n"
+        "\n",
+        id, id, id, ph.nBuckets - 1, ph.size - 1, id, id);
+
+    // FMI functions, compiled with the prefix <modelIdentifier>_
+    fprintf(out,
+        "// Function table of %s, filled by %s_loadFunctions()\n"
+        "#define MODEL_IDENTIFIER %s\n"
+        "DEFINE_LOAD_FUNCTIONS\n"
+        "#undef MODEL_IDENTIFIER\n"
+        "\n",
+        id, id, id);
+
+    free(states);
+    free(stateOf);
+    free(rows);
+    free(columns);
+    free(sorted);
+    free(ph.table);
+    free(ph.displacement);
+}
+
+/**
+ * @brief Writes the registry of the models, the first one being the default model.
+ */
+static void generateRegistry(const Generator *gens, int nModels, FILE *out) {
+    int maxVariables = 0;
+    for (int m = 0; m < nModels; m++) {
+        if (gens[m].nVariables > maxVariables) maxVariables = gens[m].nVariables;
+    }
+    fprintf(out, "#define NMODELS %d\n", nModels);
+    fprintf(out, "#define NVARIABLES %d                // largest number of variables of a model\n\n", maxVariables);
+    fprintf(out, "// Models compiled into the firmware, the first one is the default model\n");
+    fprintf(out, "const CompiledModel compiledModels[NMODELS] = {\n");
+    for (int m = 0; m < nModels; m++) {
+        const char *id = gens[m].modelIdentifier;
+        fprintf(out, "    { \"%s\", &%s_description, %s_variables, %d, %s_find_variable, %s_loadFunctions },\n",
+                id, id, id, gens[m].nVariables, id, id);
+    }
+    fprintf(out, "};\n");
+}
+
+/**
+ * @brief Returns whether a modelIdentifier can prefix C identifiers.
+ */
+static int isIdentifier(const char *s) {
+    if (!*s || (*s >= '0' && *s <= '9')) return 0;
+    for (; *s; s++) {
+        if (!(*s == '_' || (*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') || (*s >= '0' && *s <= '9'))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s modelDescription.xml [modelDescription.xml ...] modelDescription.c\n", argv[0]);
+        return 2;
+    }
+    int nModels = argc - 2;
+    const char *outFile = argv[argc - 1];
+    Generator *gens = xrealloc(NULL, nModels * sizeof(Generator));
+
+    for (int m = 0; m < nModels; m++) {
+        xmlFile = argv[m + 1];
+        xmlLine = 1;
+
+        FILE *in = fopen(xmlFile, "rb");
+        if (!in) {
+            perror(xmlFile);
+            return 1;
+        }
+        fseek(in, 0, SEEK_END);
+        long size = ftell(in);
+        fseek(in, 0, SEEK_SET);
+        char *xml = xrealloc(NULL, size + 1);
+        if (fread(xml, 1, size, in) != (size_t)size) {
+            perror(xmlFile);
+            return 1;
+        }
+        xml[size] = '\0';
+        fclose(in);
+
+        Generator *gen = &gens[m];
+        memset(gen, 0, sizeof(*gen));
+        XmlParser parser;
+        xmlInit(&parser, startElement, gen);
+        const char *error = xmlParse(&parser, xml);
+        xmlLine = parser.line;
+        if (error) fail("%s", error);
+        free(xml);
+        if (!gen->modelName || !gen->guid) fail("fmiModelDescription without modelName or guid");
+        if (!gen->modelIdentifier || !isIdentifier(gen->modelIdentifier)) {
+            fail("ModelExchange or CoSimulation without a valid modelIdentifier");
+        }
+        for (int k = 0; k < m; k++) {
+            if (strcmp(gens[k].modelIdentifier, gen->modelIdentifier) == 0) {
+                fail("modelIdentifier %s already used by %s", gen->modelIdentifier, argv[k + 1]);
+            }
+        }
+    }
+
+    FILE *out = fopen(outFile, "w");
+    if (!out) {
+        perror(outFile);
+        return 1;
+    }
+    generateHeader(out, argv + 1, nModels);
+    for (int m = 0; m < nModels; m++) {
+        xmlFile = argv[m + 1];
+        generateModel(&gens[m], out);
+    }
+    generateRegistry(gens, nModels, out);
+    if (fclose(out) != 0) {
+        perror(outFile);
+        return 1;
+    }
+    return 0;
+}
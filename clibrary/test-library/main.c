@@ -2,19 +2,29 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
+#include <limits.h>
 #include "headers/fmi2TypesPlatform.h"
 #include "headers/fmi2FunctionTypes.h"
 #include "headers/fmi2Functions.h"
-#include "fmu/sources/config.h"
-#include "fmu/sources/model.h"
 
 //Bibliothèque pour l'implémentation en micropython
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/stream.h"
+#include "py/mperrno.h"
+#include "py/mphal.h"
+#include "py/mpthread.h"
 
 //Fichier C créé pour le simulateur
 #include "fmi2.c"
+#include "profile.c"
+#include "sync.c"
+#include "arena.c"
+#include "pool.c"
+#include "solver.c"
 #include "modelDescription.c"
+#include "warmstart.c"
 
 //Affichage de messages supplémentaire si le mode debug est activé lors de la compilation avec le flag -DDEBUG
 #ifndef DEBUG
@@ -31,6 +41,72 @@
 #define min(a,b) ((a)>(b) ? (b) : (a))
 
 
+typedef struct LoadedFMU LoadedFMU;
+
+// Model that simulations are created from: an FMU compiled into the firmware, or one loaded by load_fmu()
+typedef struct {
+    FMU *fmu;                        // function table
+    const ModelDescription *description; // name, GUID and dimensions of the model
+    const ScalarVariable *variables; // variables, in the order of ModelVariables
+    int nVariables;                  // number of variables
+    int (*findVariable)(const char *name); // generated perfect hash lookup, NULL to search byName
+    const int *byName;               // variable indices sorted by name
+    const char *resourceLocation;    // URI of the resources directory, NULL if none
+    LoadedFMU *loaded;               // owner of the tables, NULL for a compiled FMU
+    int refCount;                    // Model object and simulations using a loaded FMU
+    InstancePool *pool;              // reset instances kept for the next simulations, NULL until set_pool_size()
+    WarmStartCache *warmStart;       // states after initialization, NULL until set_warm_start_size()
+} FMUModel;
+
+//Chargement des FMU à l'exécution (port unix)
+#if FMU_DLOPEN
+#include "fmuLoader.c"
+#endif
+
+// Structure to hold the user options of a simulation
+typedef struct {
+    const int *outputs;              // indices of the recorded variables, NULL for all
+    int nOutputs;                    // number of recorded variables
+    SolverType solver;               // integration method
+    double tolerance;                // relative tolerance of the integrator
+    int coSimulation;                // advance with fmi2DoStep instead of the Model Exchange loop
+    int dense;                       // interpolate the outputs instead of stopping the integrator at each step
+    Arena *arena;                    // allocator of the FMU instance, NULL for calloc() and free()
+} SimulationOptions;
+
+// Structure to hold the value references read by one batched get call per type
+typedef struct {
+    fmi2ValueReference *realVr;      // value references of the REAL outputs
+    int *realIdx;                    // output index of each REAL value reference
+    fmi2Real *realValues;            // values returned by a batched getReal
+    int nReal;                       // number of REAL outputs
+    fmi2ValueReference *intVr;       // value references of the INTEGER and ENUMERATION outputs
+    int *intIdx;                     // output index of each INTEGER value reference
+    fmi2Integer *intValues;          // values returned by a batched getInteger
+    int nInt;                        // number of INTEGER and ENUMERATION outputs
+    fmi2ValueReference *boolVr;      // value references of the BOOLEAN outputs
+    int *boolIdx;                    // output index of each BOOLEAN value reference
+    fmi2Boolean *boolValues;         // values returned by a batched getBoolean
+    int nBool;                       // number of BOOLEAN outputs
+} OutputMap;
+
+// Structure to hold the value references written by one batched set call per type
+typedef struct {
+    fmi2ValueReference *realVr;      // value references of the REAL inputs
+    int *realIdx;                    // column of each REAL input in a row of values
+    fmi2Real *realValues;            // values passed to a batched setReal
+    int nReal;                       // number of REAL inputs
+    fmi2ValueReference *intVr;       // value references of the INTEGER and ENUMERATION inputs
+    int *intIdx;                     // column of each INTEGER input in a row of values
+    fmi2Integer *intValues;          // values passed to a batched setInteger
+    int nInt;                        // number of INTEGER inputs
+    fmi2ValueReference *boolVr;      // value references of the BOOLEAN inputs
+    int *boolIdx;                    // column of each BOOLEAN input in a row of values
+    fmi2Boolean *boolValues;         // values passed to a batched setBoolean
+    int nBool;                       // number of BOOLEAN inputs
+    int nColumns;                    // number of values in a row
+} InputMap;
+
 // Structure to hold simulation state
 typedef struct {
     fmi2Component component;
@@ -40,23 +116,88 @@ typedef struct {
     double *xdot;                    // derivatives
     double *z;                       // state event indicators
     double *prez;                    // previous state event indicators
+    double *xPre;                    // continuous states at the start of the internal step
+    double *xEvent;                  // continuous states while locating a state event
+    double *zEvent;                  // state event indicators while locating a state event
+    int dense;                       // dense output: the integrator is not stopped at the output points
+    int ahead;                       // the integrator is past state->time, at the end of the last internal step
+    double tDense[2];                // start and end of the last internal step
+    double *xDense;                  // continuous states at the start and at the end of the step, 2 * nx
+    double *xdotDense;               // derivatives at the start and at the end of the step, 2 * nx
+    fmi2Boolean stateEventAhead;     // a state event was located at the end of the step
+    fmi2Boolean stepEventAhead;      // the FMU asked for a step event at the end of the step
     double time;                     // current simulation time
     double h;                        // step size
     double tStart;                   // start time
     double tEnd;                     // end time
     fmi2EventInfo eventInfo;         // event info
-    ScalarVariable *variables;       // model variables
+    fmi2CallbackFunctions *callbacks; // callbacks of the instance, which may keep a pointer to them
+    int initialized;                 // initialization mode has been left
+    int coSimulation;                // instantiated for Co-Simulation, advanced by fmi2DoStep
+    Solver solver;                   // integrator of the continuous states
+    const ScalarVariable *variables; // model variables, in the generated read-only table
     int nVariables;                  // number of variables
+    int *outputIdx;                  // variable index of each recorded output
+    int nOutputs;                    // number of recorded outputs
     double *output;                 // output array
+    OutputMap stepMap;               // outputs sampled after every step
+    OutputMap constMap;              // constant and fixed outputs, sampled at setup
     int nSteps;                      // current step count
     int nTimeEvents;                 // number of time events
     int nStateEvents;                // number of state events
     int nStepEvents;                 // number of step events
     fmi2Boolean loggingOn;          // logging flag
+    fmi2FMUstate fmuState;           // FMU state reused by the snapshots, NULL until the first one
+    InputMap inputMap;               // inputs of the input table
+    double *inputRows;               // copy of the row-major input table, row k is set before step k+1, NULL if none
+    size_t nInputRows;               // number of rows of the input table
+    Profile profile;                 // call counts and times of the phases, returned by stats()
+    Arena *arena;                    // allocator of the FMU instance, NULL for calloc() and free()
+    InstancePool *pool;              // pool the instance goes back to, NULL to free it
+    WarmStartCache *warmStart;       // cache of the states after initialization, NULL if disabled
+    InputMap keyMap;                 // variables whose start values key the cache
+    double *key;                     // key of the simulation, read before leaving initialization mode
+    uint32_t guidHash;               // hash of the model GUID and name, written in the snapshots
 } SimulationState;
 
+#define SNAPSHOT_MAGIC 0x464d5301u  // "FMS" and the version of the snapshot layout
+
+// Host side of a snapshot, followed by the event indicators and the serialized FMU state
+typedef struct {
+    uint32_t magic;                  // SNAPSHOT_MAGIC
+    uint32_t guidHash;               // hash of the GUID and name of the model that wrote the snapshot
+    int nx;                          // number of state variables
+    int nz;                          // number of state event indicators
+    size_t fmuStateSize;             // size of the serialized FMU state
+    double time;                     // simulation time
+    double hNext;                    // next internal step of the integrator
+    fmi2EventInfo eventInfo;         // event info
+    int initialized;                 // initialization mode has been left
+    int nSteps;                      // step count
+    int nTimeEvents;                 // number of time events
+    int nStateEvents;                // number of state events
+    int nStepEvents;                 // number of step events
+} SnapshotHeader;
+
+/**
+ * @brief FNV-1a hash of a model GUID and name, so that a snapshot is only restored into the same model.
+ *
+ * The name is hashed too because FMUs built from the same sources may keep
+ * the same GUID.
+ */
+static uint32_t snapshotGuidHash(const ModelDescription *description) {
+    uint32_t hash = 2166136261u;
+    const char *parts[2] = { description->guid, description->modelName };
+    for (int i = 0; i < 2; i++) {
+        for (const char *c = parts[i]; c && *c; c++) {
+            hash = (hash ^ (unsigned char)*c) * 16777619u;
+        }
+        hash = (hash ^ 0xffu) * 16777619u;
+    }
+    return hash;
+}
+
 
-FMU fmu;
 /**
  * @brief Converts an fmi2Status enum value to its corresponding string representation.
  *
@@ -129,6 +270,321 @@ int error(const char *message) {
 	return 0;
 }
 
+/**
+ * @brief Returns whether a variable keeps the same value after initialization.
+ *
+ * @param var Pointer to the variable
+ * @return 1 for constant and fixed variables, 0 otherwise
+ */
+static int isSampledOnce(const ScalarVariable *var) {
+    return var->variability == CONSTANT || var->variability == FIXED;
+}
+
+/**
+ * @brief Frees the value reference tables of an output map.
+ *
+ * @param map Pointer to the output map
+ */
+static void freeOutputMap(OutputMap *map) {
+    if (map->realVr) free(map->realVr);
+    if (map->realIdx) free(map->realIdx);
+    if (map->realValues) free(map->realValues);
+    if (map->intVr) free(map->intVr);
+    if (map->intIdx) free(map->intIdx);
+    if (map->intValues) free(map->intValues);
+    if (map->boolVr) free(map->boolVr);
+    if (map->boolIdx) free(map->boolIdx);
+    if (map->boolValues) free(map->boolValues);
+}
+
+/**
+ * @brief Groups the value references of the recorded outputs by type.
+ *
+ * The REAL, INTEGER (with ENUMERATION) and BOOLEAN value references are stored
+ * in contiguous arrays so that sampleOutputs() reads all the outputs of the map
+ * with one getReal, one getInteger and one getBoolean call. STRING outputs are
+ * not sampled and stay 0.
+ *
+ * @param state Pointer to the simulation state
+ * @param map Pointer to the output map to fill
+ * @param sampledOnce 1 to keep the constant and fixed outputs, 0 to keep the others
+ * @return 0 on success, -1 on allocation failure
+ */
+static int buildOutputMap(SimulationState *state, OutputMap *map, int sampledOnce) {
+    map->nReal = 0;
+    map->nInt = 0;
+    map->nBool = 0;
+    for (int k = 0; k < state->nOutputs; k++) {
+        const ScalarVariable *var = &state->variables[state->outputIdx[k]];
+        if (isSampledOnce(var) != sampledOnce) continue;
+        if (var->type == REAL) map->nReal++;
+        else if (var->type == INTEGER || var->type == ENUMERATION) map->nInt++;
+        else if (var->type == BOOLEAN) map->nBool++;
+    }
+
+    map->realVr = (fmi2ValueReference*)calloc(map->nReal + 1, sizeof(fmi2ValueReference));
+    map->realIdx = (int*)calloc(map->nReal + 1, sizeof(int));
+    map->realValues = (fmi2Real*)calloc(map->nReal + 1, sizeof(fmi2Real));
+    map->intVr = (fmi2ValueReference*)calloc(map->nInt + 1, sizeof(fmi2ValueReference));
+    map->intIdx = (int*)calloc(map->nInt + 1, sizeof(int));
+    map->intValues = (fmi2Integer*)calloc(map->nInt + 1, sizeof(fmi2Integer));
+    map->boolVr = (fmi2ValueReference*)calloc(map->nBool + 1, sizeof(fmi2ValueReference));
+    map->boolIdx = (int*)calloc(map->nBool + 1, sizeof(int));
+    map->boolValues = (fmi2Boolean*)calloc(map->nBool + 1, sizeof(fmi2Boolean));
+    if (!map->realVr || !map->realIdx || !map->realValues ||
+        !map->intVr || !map->intIdx || !map->intValues ||
+        !map->boolVr || !map->boolIdx || !map->boolValues) {
+        return -1;
+    }
+
+    int r = 0, n = 0, b = 0;
+    for (int k = 0; k < state->nOutputs; k++) {
+        const ScalarVariable *var = &state->variables[state->outputIdx[k]];
+        if (isSampledOnce(var) != sampledOnce) continue;
+        if (var->type == REAL) {
+            map->realVr[r] = var->valueReference;
+            map->realIdx[r++] = k;
+        } else if (var->type == INTEGER || var->type == ENUMERATION) {
+            map->intVr[n] = var->valueReference;
+            map->intIdx[n++] = k;
+        } else if (var->type == BOOLEAN) {
+            map->boolVr[b] = var->valueReference;
+            map->boolIdx[b++] = k;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the outputs of an output map into state->output.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @param map Pointer to the output map to read
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status readOutputs(FMU *fmu, SimulationState *state, OutputMap *map) {
+    fmi2Status fmi2Flag = fmi2OK;
+
+    if (map->nReal > 0) {
+        fmi2Flag = fmu->getReal(state->component, map->realVr, map->nReal, map->realValues);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        for (int i = 0; i < map->nReal; i++) {
+            state->output[map->realIdx[i]] = map->realValues[i];
+        }
+    }
+
+    if (map->nInt > 0) {
+        fmi2Status intFlag = fmu->getInteger(state->component, map->intVr, map->nInt, map->intValues);
+        if (intFlag > fmi2Flag) fmi2Flag = intFlag;
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        for (int i = 0; i < map->nInt; i++) {
+            state->output[map->intIdx[i]] = (double)map->intValues[i];
+        }
+    }
+
+    if (map->nBool > 0) {
+        fmi2Status boolFlag = fmu->getBoolean(state->component, map->boolVr, map->nBool, map->boolValues);
+        if (boolFlag > fmi2Flag) fmi2Flag = boolFlag;
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        for (int i = 0; i < map->nBool; i++) {
+            state->output[map->boolIdx[i]] = map->boolValues[i] ? 1.0 : 0.0;
+        }
+    }
+
+    return fmi2Flag;
+}
+
+/**
+ * @brief Reads the outputs of an output map into state->output, counted in the sampling phase.
+ */
+static fmi2Status sampleOutputs(FMU *fmu, SimulationState *state, OutputMap *map) {
+    fmi2Status fmi2Flag;
+    PROFILE(&state->profile, PROFILE_SAMPLING, fmi2Flag = readOutputs(fmu, state, map));
+    return fmi2Flag;
+}
+
+/**
+ * @brief Frees the value reference tables of an input map.
+ *
+ * @param map Pointer to the input map
+ */
+static void freeInputMap(InputMap *map) {
+    if (map->realVr) free(map->realVr);
+    if (map->realIdx) free(map->realIdx);
+    if (map->realValues) free(map->realValues);
+    if (map->intVr) free(map->intVr);
+    if (map->intIdx) free(map->intIdx);
+    if (map->intValues) free(map->intValues);
+    if (map->boolVr) free(map->boolVr);
+    if (map->boolIdx) free(map->boolIdx);
+    if (map->boolValues) free(map->boolValues);
+    memset(map, 0, sizeof(InputMap));
+}
+
+/**
+ * @brief Groups the value references of a set of inputs by type.
+ *
+ * Column k of a row of values is written to the variable inputs[k], so that
+ * applyInputs() sets a whole row with one setReal, one setInteger and one
+ * setBoolean call.
+ *
+ * @param variables Table of the model variables
+ * @param inputs Variable index of each column, STRING variables are not allowed
+ * @param nInputs Number of columns
+ * @param map Pointer to the input map to fill, freed with freeInputMap()
+ * @return 0 on success, -1 on allocation failure
+ */
+static int buildInputMap(const ScalarVariable *variables, const int *inputs, int nInputs, InputMap *map) {
+    memset(map, 0, sizeof(InputMap));
+    map->nColumns = nInputs;
+    int nReal = 0, nInt = 0, nBool = 0;
+    for (int k = 0; k < nInputs; k++) {
+        VarType type = variables[inputs[k]].type;
+        if (type == REAL) nReal++;
+        else if (type == BOOLEAN) nBool++;
+        else nInt++;
+    }
+
+    map->realVr = (fmi2ValueReference*)calloc(nReal + 1, sizeof(fmi2ValueReference));
+    map->realIdx = (int*)calloc(nReal + 1, sizeof(int));
+    map->realValues = (fmi2Real*)calloc(nReal + 1, sizeof(fmi2Real));
+    map->intVr = (fmi2ValueReference*)calloc(nInt + 1, sizeof(fmi2ValueReference));
+    map->intIdx = (int*)calloc(nInt + 1, sizeof(int));
+    map->intValues = (fmi2Integer*)calloc(nInt + 1, sizeof(fmi2Integer));
+    map->boolVr = (fmi2ValueReference*)calloc(nBool + 1, sizeof(fmi2ValueReference));
+    map->boolIdx = (int*)calloc(nBool + 1, sizeof(int));
+    map->boolValues = (fmi2Boolean*)calloc(nBool + 1, sizeof(fmi2Boolean));
+    if (!map->realVr || !map->realIdx || !map->realValues ||
+        !map->intVr || !map->intIdx || !map->intValues ||
+        !map->boolVr || !map->boolIdx || !map->boolValues) {
+        freeInputMap(map);
+        return -1;
+    }
+
+    for (int k = 0; k < nInputs; k++) {
+        const ScalarVariable *var = &variables[inputs[k]];
+        if (var->type == REAL) {
+            map->realVr[map->nReal] = var->valueReference;
+            map->realIdx[map->nReal++] = k;
+        } else if (var->type == BOOLEAN) {
+            map->boolVr[map->nBool] = var->valueReference;
+            map->boolIdx[map->nBool++] = k;
+        } else {
+            map->intVr[map->nInt] = var->valueReference;
+            map->intIdx[map->nInt++] = k;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Brings a dense output simulation back from the end of its last internal step.
+ *
+ * Called before the variables or the state of the FMU are changed or captured
+ * between two steps: the FMU is moved back to the output point (state->time,
+ * state->x), and the integration goes on from there.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status denseRewind(FMU *fmu, SimulationState *state) {
+    if (!state->ahead) return fmi2OK;
+    state->ahead = 0;
+    fmi2Status fmi2Flag = fmu->setTime(state->component, state->time);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Flag = fmu->setContinuousStates(state->component, state->x, state->nx);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    solverReset(&state->solver);
+    PROFILE(&state->profile, PROFILE_EVENT_INDICATORS,
+            fmi2Flag = fmu->getEventIndicators(state->component, state->z, state->nz));
+    return fmi2Flag;
+}
+
+/**
+ * @brief Sets the inputs of an input map from a row of values.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @param map Pointer to the input map
+ * @param row One value per column of the map
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status applyInputs(FMU *fmu, SimulationState *state, InputMap *map, const double *row) {
+    fmi2Status fmi2Flag = denseRewind(fmu, state);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    solverForgetDerivatives(&state->solver);
+
+    if (map->nReal > 0) {
+        for (int i = 0; i < map->nReal; i++) {
+            map->realValues[i] = row[map->realIdx[i]];
+        }
+        fmi2Flag = fmu->setReal(state->component, map->realVr, map->nReal, map->realValues);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    }
+
+    if (map->nInt > 0) {
+        for (int i = 0; i < map->nInt; i++) {
+            map->intValues[i] = (fmi2Integer)row[map->intIdx[i]];
+        }
+        fmi2Status intFlag = fmu->setInteger(state->component, map->intVr, map->nInt, map->intValues);
+        if (intFlag > fmi2Flag) fmi2Flag = intFlag;
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    }
+
+    if (map->nBool > 0) {
+        for (int i = 0; i < map->nBool; i++) {
+            map->boolValues[i] = row[map->boolIdx[i]] != 0;
+        }
+        fmi2Status boolFlag = fmu->setBoolean(state->component, map->boolVr, map->nBool, map->boolValues);
+        if (boolFlag > fmi2Flag) fmi2Flag = boolFlag;
+    }
+
+    return fmi2Flag;
+}
+
+/**
+ * @brief Reads the variables of an input map into a row of values, the reverse of applyInputs().
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @param map Pointer to the input map
+ * @param row Set to one value per column of the map
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status readValues(FMU *fmu, SimulationState *state, InputMap *map, double *row) {
+    fmi2Status fmi2Flag = fmi2OK;
+
+    if (map->nReal > 0) {
+        fmi2Flag = fmu->getReal(state->component, map->realVr, map->nReal, map->realValues);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        for (int i = 0; i < map->nReal; i++) {
+            row[map->realIdx[i]] = map->realValues[i];
+        }
+    }
+
+    if (map->nInt > 0) {
+        fmi2Status intFlag = fmu->getInteger(state->component, map->intVr, map->nInt, map->intValues);
+        if (intFlag > fmi2Flag) fmi2Flag = intFlag;
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        for (int i = 0; i < map->nInt; i++) {
+            row[map->intIdx[i]] = (double)map->intValues[i];
+        }
+    }
+
+    if (map->nBool > 0) {
+        fmi2Status boolFlag = fmu->getBoolean(state->component, map->boolVr, map->nBool, map->boolValues);
+        if (boolFlag > fmi2Flag) fmi2Flag = boolFlag;
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        for (int i = 0; i < map->nBool; i++) {
+            row[map->boolIdx[i]] = map->boolValues[i] ? 1.0 : 0.0;
+        }
+    }
+
+    return fmi2Flag;
+}
+
 /**
  * @brief Frees all resources associated with the simulation state.
  *
@@ -140,75 +596,172 @@ void cleanupSimulation(FMU *fmu, SimulationState *state) {
 
     // Terminate the FMU
     if (state->component) {
-        fmu->terminate(state->component);
-        fmu->freeInstance(state->component);
+        Arena *previous = arenaBind(state->arena);
+        // fmi2Terminate is only allowed once initialization mode has been left
+        if (state->initialized) fmu->terminate(state->component);
+        if (state->fmuState) fmu->freeFMUstate(state->component, &state->fmuState);
+        if (state->pool) {
+            PooledInstance instance = {state->component, state->callbacks, state->coSimulation};
+            poolPut(state->pool, fmu, &instance);
+        } else {
+            fmu->freeInstance(state->component);
+            free(state->callbacks);
+        }
+        arenaBind(previous);
+    } else {
+        free(state->callbacks);
     }
+    // The instance is gone, whatever it did not free goes back to its arena
+    if (state->arena) arenaReset(state->arena);
 
     // Free state variables
     if (state->x) free(state->x);
     if (state->xdot) free(state->xdot);
     if (state->z) free(state->z);
     if (state->prez) free(state->prez);
+    if (state->xPre) free(state->xPre);
+    if (state->xEvent) free(state->xEvent);
+    if (state->zEvent) free(state->zEvent);
+    if (state->xDense) free(state->xDense);
+    if (state->xdotDense) free(state->xdotDense);
+    solverFree(&state->solver);
 
     // Free output array
     if (state->output) {
         free(state->output);
     }
+    if (state->outputIdx) free(state->outputIdx);
+
+    // Free value reference tables
+    freeOutputMap(&state->stepMap);
+    freeOutputMap(&state->constMap);
+    freeInputMap(&state->inputMap);
+    freeInputMap(&state->keyMap);
+    if (state->inputRows) free(state->inputRows);
+    if (state->key) free(state->key);
 
     // Free the state structure itself
     free(state);
 }
 
 /**
- * @brief Initializes the FMU simulation and returns a simulation state structure.
- *
- * @param fmu Pointer to the FMU structure
- * @param tEnd End time for simulation
- * @param h Step size
- * @return SimulationState* Pointer to initialized simulation state, NULL if error
+ * @brief Instantiates and initializes the FMU, with the arena of the options bound.
  */
-SimulationState* initializeSimulation(FMU *fmu, double tStart, double tEnd, double h) {
+static SimulationState* instantiateSimulation(const FMUModel *fmuModel, double tStart, double tEnd, double h,
+                                              const SimulationOptions *options) {
+    FMU *fmu = fmuModel->fmu;
     SimulationState *state = (SimulationState*)calloc(1, sizeof(SimulationState));
     if (!state) return NULL;
 
     state->time = tStart;
+    state->tStart = tStart;
     state->h = h;
     state->tEnd = tEnd;
     state->nSteps = 0;
     state->nTimeEvents = 0;
     state->nStateEvents = 0;
     state->nStepEvents = 0;
+    state->coSimulation = options->coSimulation;
+    state->arena = options->arena;
+
+    // Instances allocating from an arena are never pooled: a reset instance
+    // still uses its blocks, so the arena is only reset once the instance is
+    // freed, by cleanupSimulation()
+    state->pool = state->arena ? NULL : fmuModel->pool;
+
+    // Take a reset instance from the pool, or instantiate the FMU
+    PooledInstance pooled;
+    if (state->pool && poolTake(state->pool, state->coSimulation, &pooled)) {
+        state->component = pooled.component;
+        state->callbacks = pooled.callbacks;
+    } else {
+        // Setup callback functions, the instance allocates from its arena if it has one
+        state->callbacks = (fmi2CallbackFunctions*)malloc(sizeof(fmi2CallbackFunctions));
+        if (!state->callbacks) {
+            cleanupSimulation(fmu,state);
+            return NULL;
+        }
+        fmi2CallbackFunctions callbacks = {fmuLogger, calloc, free, NULL, fmu};
+        if (state->arena) {
+            callbacks.allocateMemory = arenaAllocate;
+            callbacks.freeMemory = arenaFree;
+        }
+        *state->callbacks = callbacks;
 
-    // Setup callback functions
-    fmi2CallbackFunctions callbacks = {fmuLogger, calloc, free, NULL, fmu};
-
-    // Instantiate the FMU
-    state->component = fmu->instantiate(model.modelName, fmi2ModelExchange, 
-                                      model.guid, NULL, &callbacks, fmi2False, fmi2False);
-    if (!state->component) {
-        cleanupSimulation(fmu,state);
-        return NULL;
+        state->component = fmu->instantiate(fmuModel->description->modelName,
+                                          state->coSimulation ? fmi2CoSimulation : fmi2ModelExchange,
+                                          fmuModel->description->guid, fmuModel->resourceLocation,
+                                          state->callbacks, fmi2False, fmi2False);
+        if (!state->component) {
+            cleanupSimulation(fmu,state);
+            return NULL;
+        }
     }
 
     // Get state dimensions
-    state->nx = model.numberOfContinuousStates;
-    state->nz = model.numberOfEventIndicators;
+    state->nx = fmuModel->description->numberOfContinuousStates;
+    state->nz = fmuModel->description->numberOfEventIndicators;
 
     // Allocate memory for states and indicators
     state->x = (double*)calloc(state->nx, sizeof(double));
     state->xdot = (double*)calloc(state->nx, sizeof(double));
+    state->xPre = (double*)calloc(state->nx + 1, sizeof(double));
+    state->xEvent = (double*)calloc(state->nx + 1, sizeof(double));
 
     if (state->nz > 0) {
         state->z = (double*)calloc(state->nz, sizeof(double));
         state->prez = (double*)calloc(state->nz, sizeof(double));
+        state->zEvent = (double*)calloc(state->nz, sizeof(double));
     }
 
-    if ((!state->x || !state->xdot) || 
-        (state->nz > 0 && (!state->z || !state->prez))) {
+    if ((!state->x || !state->xdot || !state->xPre || !state->xEvent) || 
+        (state->nz > 0 && (!state->z || !state->prez || !state->zEvent)) ||
+        solverInit(&state->solver, options->solver, state->nx, options->tolerance) < 0) {
         // Cleanup and return on allocation failure
         cleanupSimulation(fmu,state);
         return NULL;
     }
+    state->solver.profile = &state->profile;
+
+    // Dense output keeps the last internal step to interpolate the outputs
+    if (options->dense) {
+        state->dense = 1;
+        state->xDense = (double*)calloc(2 * state->nx + 1, sizeof(double));
+        state->xdotDense = (double*)calloc(2 * state->nx + 1, sizeof(double));
+        if (!state->xDense || !state->xdotDense) {
+            cleanupSimulation(fmu,state);
+            return NULL;
+        }
+    }
+
+    // Colour the Jacobian of the BDF integrator with the dependencies of the derivatives
+    const ModelDescription *description = fmuModel->description;
+    if (options->solver == SOLVER_BDF && state->nx > 0 && description->jacobianRows) {
+        fmi2ValueReference *stateVr = NULL, *derivativeVr = NULL;
+        if (description->providesDirectionalDerivative && fmu->getDirectionalDerivative) {
+            stateVr = (fmi2ValueReference*)calloc(state->nx, sizeof(fmi2ValueReference));
+            derivativeVr = (fmi2ValueReference*)calloc(state->nx, sizeof(fmi2ValueReference));
+            if (!stateVr || !derivativeVr) {
+                free(stateVr);
+                free(derivativeVr);
+                cleanupSimulation(fmu,state);
+                return NULL;
+            }
+            for (int i = 0; i < state->nx; i++) {
+                const ScalarVariable *derivative = &fmuModel->variables[description->derivatives[i]];
+                derivativeVr[i] = derivative->valueReference;
+                stateVr[i] = fmuModel->variables[derivative->derivative - 1].valueReference;
+            }
+        }
+        int failed = solverSetJacobian(&state->solver, description->jacobianRows,
+                                       description->jacobianColumns, stateVr, derivativeVr);
+        free(stateVr);
+        free(derivativeVr);
+        if (failed < 0) {
+            cleanupSimulation(fmu,state);
+            return NULL;
+        }
+    }
 
     // Setup experiment
     fmi2Boolean toleranceDefined = fmi2False;
@@ -231,367 +784,2895 @@ SimulationState* initializeSimulation(FMU *fmu, double tStart, double tEnd, doub
 
     // Initialize variables and output array
 	// Output is an array which value get replaced with each itearation
-    get_variable_list(&state->variables);
-    state->nVariables = get_variable_count();
-    state->output = (double*)calloc(state->nVariables, sizeof(double*));
+    state->variables = fmuModel->variables;
+    state->guidHash = snapshotGuidHash(fmuModel->description);
+    state->nVariables = fmuModel->nVariables;
+    state->nOutputs = options->outputs ? options->nOutputs : state->nVariables;
+    state->outputIdx = (int*)calloc(state->nOutputs + 1, sizeof(int));
+    state->output = (double*)calloc(state->nOutputs + 1, sizeof(double));
+    if (!state->outputIdx || !state->output) {
+        cleanupSimulation(fmu,state);
+        return NULL;
+    }
+    for (int k = 0; k < state->nOutputs; k++) {
+        state->outputIdx[k] = options->outputs ? options->outputs[k] : k;
+    }
+    if (buildOutputMap(state, &state->stepMap, 0) < 0 ||
+        buildOutputMap(state, &state->constMap, 1) < 0) {
+        cleanupSimulation(fmu,state);
+        return NULL;
+    }
 
-    // Initialize first output values
-    for (int i = 0; i < state->nVariables; i++) {
-        if (state->variables[i].type == REAL) {
-            fmu->getReal(state->component, &state->variables[i].valueReference, 
-                        1, &state->output[i]);
-        } else if (state->variables[i].type == INTEGER) {
-            fmi2Integer intValue;
-            fmu->getInteger(state->component, &state->variables[i].valueReference, 
-                           1, &intValue);
-            state->output[i] = (double)intValue;
+    // Start values are read back into the key of the warm start cache before the first step.
+    // A Co-Simulation FMU may only set up its solver in fmi2ExitInitializationMode, so
+    // its state cannot be restored before: only Model Exchange simulations use the cache.
+    if (fmuModel->warmStart && !state->coSimulation) {
+        WarmStartCache *cache = fmuModel->warmStart;
+        state->key = (double*)calloc(cache->nKey, sizeof(double));
+        if (!state->key || buildInputMap(state->variables, cache->keyVars, cache->nKeyVars, &state->keyMap) < 0) {
+            cleanupSimulation(fmu,state);
+            return NULL;
         }
+        state->key[0] = state->tStart;
+        state->key[1] = state->tEnd;
+        state->warmStart = cache;
     }
 
+    // Initialize first output values
+    sampleOutputs(fmu, state, &state->constMap);
+    sampleOutputs(fmu, state, &state->stepMap);
+
     return state;
 }
 
 /**
- * @brief Performs one simulation step and updates the simulation state.
+ * @brief Initializes the FMU simulation and returns a simulation state structure.
+ *
+ * @param fmuModel Model to instantiate
+ * @param tEnd End time for simulation
+ * @param h Step size
+ * @param options Recorded outputs, integration method and allocator of the instance
+ * @return SimulationState* Pointer to initialized simulation state, NULL if error
+ */
+SimulationState* initializeSimulation(const FMUModel *fmuModel, double tStart, double tEnd, double h,
+                                      const SimulationOptions *options) {
+    Arena *previous = arenaBind(options->arena);
+    SimulationState *state = instantiateSimulation(fmuModel, tStart, tEnd, h, options);
+    arenaBind(previous);
+    return state;
+}
+
+/**
+ * @brief Captures the FMU state and returns the size of the snapshot of the simulation.
+ *
+ * The FMU state is kept in state->fmuState until writeSnapshot() serializes it.
  *
  * @param fmu Pointer to the FMU structure
  * @param state Pointer to the simulation state
- * @return fmi2Status Status of the simulation step
+ * @param size Set to the size of the snapshot
+ * @return fmi2Status Worst status returned by the FMU
  */
-fmi2Status simulationDoStep(FMU *fmu, SimulationState *state) {
-
-	//fmi2FMUstate *fmuState = calloc(1, sizeof(fmi2FMUstate));
-	fmi2Status fmi2Flag;
-	double tPre = state->time;
-    double dt;
-    fmi2Boolean timeEvent, stateEvent, stepEvent, terminateSimulation;
-
-	//TODO: Voir si y'a moyen de faire ça sans tricher...
-	ModelInstance* comp = (ModelInstance*)state->component;
-	//printf("Model instance values: %d \n", comp->state);
+static fmi2Status takeSnapshot(FMU *fmu, SimulationState *state, size_t *size) {
+    fmi2Status fmi2Flag = denseRewind(fmu, state);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Flag = fmu->getFMUstate(state->component, &state->fmuState);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
 
-    if (!state->eventInfo.terminateSimulation && comp->state <= InitializationMode) {
-            fmi2Flag = fmu->exitInitializationMode(state->component);
-        if (fmi2Flag > fmi2Warning) {
-            cleanupSimulation(fmu,state);
-            return fmi2Flag;
-        }
+    size_t fmuStateSize;
+    fmi2Flag = fmu->serializedFMUstateSize(state->component, state->fmuState, &fmuStateSize);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
 
-        // Initial event iteration
-        state->eventInfo.newDiscreteStatesNeeded = fmi2True;
-        state->eventInfo.terminateSimulation = fmi2False;
-        while (state->eventInfo.newDiscreteStatesNeeded && 
-                !state->eventInfo.terminateSimulation) {
-            fmi2Flag = fmu->newDiscreteStates(state->component, &state->eventInfo);
-            if (fmi2Flag > fmi2Warning) {
-                cleanupSimulation(fmu,state);
-                return fmi2Flag;
-            }
-        }
-    }
+    *size = sizeof(SnapshotHeader) + state->nz * sizeof(double) + fmuStateSize;
+    return fmi2Flag;
+}
 
+/**
+ * @brief Writes the snapshot captured by takeSnapshot() into a buffer.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @param data Buffer of the size returned by takeSnapshot()
+ * @param size Size of the buffer
+ * @return fmi2Status Status returned by the FMU
+ */
+static fmi2Status writeSnapshot(FMU *fmu, SimulationState *state, fmi2Byte *data, size_t size) {
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.guidHash = state->guidHash;
+    header.nx = state->nx;
+    header.nz = state->nz;
+    header.fmuStateSize = size - sizeof(SnapshotHeader) - state->nz * sizeof(double);
+    header.time = state->time;
+    header.hNext = state->solver.hNext;
+    header.eventInfo = state->eventInfo;
+    header.initialized = state->initialized;
+    header.nSteps = state->nSteps;
+    header.nTimeEvents = state->nTimeEvents;
+    header.nStateEvents = state->nStateEvents;
+    header.nStepEvents = state->nStepEvents;
+
+    memcpy(data, &header, sizeof(header));
+    data += sizeof(header);
+    memcpy(data, state->z, state->nz * sizeof(double));
+    data += state->nz * sizeof(double);
+    return fmu->serializeFMUstate(state->component, state->fmuState, data, header.fmuStateSize);
+}
 
-	if (!state->eventInfo.terminateSimulation && comp->state < ContinuousTimeMode) {
-		fmi2Flag = fmu->enterContinuousTimeMode(state->component);
-		if (fmi2Flag > fmi2Warning) {
-			cleanupSimulation(fmu,state);
-			INFO("Error entering continuous time mode\n");
-			return fmi2Flag;
-		}
-	}
+/**
+ * @brief Returns whether a buffer holds a snapshot of a simulation of this model.
+ */
+static int isValidSnapshot(const SimulationState *state, const fmi2Byte *data, size_t size) {
+    SnapshotHeader header;
+    if (size < sizeof(header)) return 0;
+    memcpy(&header, data, sizeof(header));
+    return header.magic == SNAPSHOT_MAGIC && header.guidHash == state->guidHash &&
+           header.nx == state->nx && header.nz == state->nz &&
+           size == sizeof(header) + state->nz * sizeof(double) + header.fmuStateSize;
+}
 
-    INFO("Entering simulation loop\n");
-	if (state->time >= state->tEnd || state->eventInfo.terminateSimulation) {
-        INFO("Simulation already terminated\n");
-		return fmi2Discard;
+/**
+ * @brief Rewinds a simulation to a snapshot written by writeSnapshot().
+ *
+ * The snapshot may come from another simulation of the same model. The
+ * integrator history is dropped and the outputs are sampled again.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @param data Snapshot, checked with isValidSnapshot()
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status restoreSnapshot(FMU *fmu, SimulationState *state, const fmi2Byte *data) {
+    SnapshotHeader header;
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+
+    // An FMU may only allocate its solver when leaving initialization mode: a
+    // simulation which has not made its first step leaves it before restoring
+    if (header.initialized && !state->initialized) {
+        fmi2Status fmi2Flag = fmu->exitInitializationMode(state->component);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        state->initialized = 1;
     }
 
-    //fmi2Status fmi2Flag;
-
-    // Get current state and derivatives
-    fmi2Flag = fmu->getContinuousStates(state->component, state->x, state->nx);
+    fmi2Status fmi2Flag = fmu->deSerializeFMUstate(state->component,
+                                                   data + state->nz * sizeof(double),
+                                                   header.fmuStateSize, &state->fmuState);
     if (fmi2Flag > fmi2Warning) return fmi2Flag;
-
-    fmi2Flag = fmu->getDerivatives(state->component, state->xdot, state->nx);
+    fmi2Flag = fmu->setFMUstate(state->component, state->fmuState);
     if (fmi2Flag > fmi2Warning) return fmi2Flag;
 
-	INFO("States and derivatives retrieved\n");
+    memcpy(state->z, data, state->nz * sizeof(double));
+    state->time = header.time;
+    state->eventInfo = header.eventInfo;
+    state->initialized = header.initialized;
+    state->nSteps = header.nSteps;
+    state->nTimeEvents = header.nTimeEvents;
+    state->nStateEvents = header.nStateEvents;
+    state->nStepEvents = header.nStepEvents;
+    state->ahead = 0;
+    solverReset(&state->solver);
+    state->solver.hNext = header.hNext;
+
+    fmi2Flag = sampleOutputs(fmu, state, &state->constMap);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    return sampleOutputs(fmu, state, &state->stepMap);
+}
 
-    // Advance time
-    state->time = min(state->time + state->h, state->tEnd);
-    timeEvent = state->eventInfo.nextEventTimeDefined && 
-                state->time >= state->eventInfo.nextEventTime;
-    
-    if (timeEvent) state->time = state->eventInfo.nextEventTime;
-    dt = state->time - tPre;
-    
-    fmi2Flag = fmu->setTime(state->component, state->time);
+/**
+ * @brief Restores the state after initialization stored for the start values of a simulation.
+ *
+ * Called in initialization mode, before the first step. The start values are
+ * read back from the FMU, so that they count however they were set. On a
+ * hit, the simulation leaves initialization mode through the snapshot.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @return fmi2Status Worst status returned by the FMU, fmi2OK on a miss
+ */
+static fmi2Status warmStartRestore(FMU *fmu, SimulationState *state) {
+    if (!state->warmStart) return fmi2OK;
+    fmi2Status fmi2Flag = readValues(fmu, state, &state->keyMap, state->key + WARM_START_KEY_HEADER);
     if (fmi2Flag > fmi2Warning) return fmi2Flag;
 
-	INFO("Time set\n");
+    fmi2Byte *snapshot;
+    size_t size;
+    if (!warmStartLookup(state->warmStart, state->key, &snapshot, &size)) return fmi2OK;
+    fmi2Flag = isValidSnapshot(state, snapshot, size) ? restoreSnapshot(fmu, state, snapshot) : fmi2Error;
+    free(snapshot);
+    return fmi2Flag;
+}
 
-    // Perform one step (forward Euler)
-    for (int i = 0; i < state->nx; i++) {
-        state->x[i] += dt * state->xdot[i];
-    }
-    
+/**
+ * @brief Stores the state of a simulation which has just been initialized, for warmStartRestore().
+ *
+ * A snapshot that cannot be taken is not stored, the simulation goes on.
+ */
+static void warmStartSave(FMU *fmu, SimulationState *state) {
+    if (!state->warmStart) return;
+    size_t size;
+    if (takeSnapshot(fmu, state, &size) > fmi2Warning) return;
+    fmi2Byte *snapshot = (fmi2Byte*)malloc(size);
+    if (!snapshot) return;
+    if (writeSnapshot(fmu, state, snapshot, size) > fmi2Warning) {
+        free(snapshot);
+        return;
+    }
+    warmStartStore(state->warmStart, state->key, snapshot, size);
+}
+
+#define EVENT_MAX_ITERATIONS 50
+
+/**
+ * @brief Returns whether an event indicator changed sign between two sets of values.
+ */
+static int eventIndicatorsCrossed(const double *za, const double *zb, int nz) {
+    for (int i = 0; i < nz; i++) {
+        if (za[i] * zb[i] < 0) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Locates the first zero crossing of the event indicators inside the last internal step.
+ *
+ * The step went from (tPre, state->xPre, state->prez) to (state->time, state->x, state->z)
+ * and at least one indicator changed sign. The crossing time is searched with the
+ * Illinois variant of regula falsi; each trial time is evaluated by rolling the
+ * continuous states back to tPre and re-integrating up to it. On return the
+ * simulation state and the FMU are at the right end of the final bracket, just
+ * past the crossing.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @param tPre Start time of the internal step
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status locateStateEvent(FMU *fmu, SimulationState *state, double tPre) {
+    double ta = tPre, tb = state->time;
+    double *za = state->prez, *zb = state->z;
+    double tol = 1e-12 * fmax(fabs(tb), 1.0);
+    int side = 0;                    // side of the bracket kept by the last iteration
+    fmi2Status fmi2Flag = fmi2OK;
+
+    // za is scaled by the Illinois rule: work on a copy of the left values
+    memcpy(state->zEvent, za, state->nz * sizeof(double));
+    za = state->zEvent;
+    double *zc = state->prez;        // prez is no longer needed once copied
+
+    for (int iter = 0; iter < EVENT_MAX_ITERATIONS && tb - ta > tol; iter++) {
+        // Earliest regula falsi estimate over the indicators that crossed
+        double tc = tb;
+        for (int i = 0; i < state->nz; i++) {
+            if (za[i] * zb[i] < 0) {
+                double ti = tb - zb[i] * (tb - ta) / (zb[i] - za[i]);
+                if (ti < tc) tc = ti;
+            }
+        }
+        // Keep the trial point strictly inside the bracket
+        tc = fmin(fmax(tc, ta + 0.5 * tol), tb - 0.5 * tol);
+
+        fmi2Flag = solverStepTo(&state->solver, fmu, state->component, tPre,
+                                state->xPre, state->xdot, tc, state->xEvent);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        PROFILE(&state->profile, PROFILE_EVENT_INDICATORS,
+                fmi2Flag = fmu->getEventIndicators(state->component, zc, state->nz));
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+        if (eventIndicatorsCrossed(za, zc, state->nz)) {
+            // The crossing is in [ta, tc]
+            tb = tc;
+            memcpy(zb, zc, state->nz * sizeof(double));
+            memcpy(state->x, state->xEvent, state->nx * sizeof(double));
+            if (side == -1) {
+                for (int i = 0; i < state->nz; i++) za[i] *= 0.5;
+            }
+            side = -1;
+        } else {
+            // The crossing is in [tc, tb]
+            ta = tc;
+            memcpy(za, zc, state->nz * sizeof(double));
+            if (side == 1) {
+                for (int i = 0; i < state->nz; i++) zb[i] *= 0.5;
+            }
+            side = 1;
+        }
+    }
+
+    // Leave the FMU just past the crossing
+    state->time = tb;
+    fmi2Flag = fmu->setTime(state->component, tb);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
     fmi2Flag = fmu->setContinuousStates(state->component, state->x, state->nx);
     if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    PROFILE(&state->profile, PROFILE_EVENT_INDICATORS,
+            fmi2Flag = fmu->getEventIndicators(state->component, state->z, state->nz));
+    return fmi2Flag;
+}
+
+/**
+ * @brief Samples the outputs of a dense output simulation at a point inside its last internal step.
+ *
+ * The continuous states are interpolated at t, and the FMU is moved there to
+ * read the outputs, then back to the end of the step, where the integration
+ * goes on at the next step.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state, ahead of t
+ * @param t Output time, inside the last internal step
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status denseSample(FMU *fmu, SimulationState *state, double t) {
+    int nx = state->nx;
+    solverHermite(nx, state->tDense[0], state->xDense, state->xdotDense,
+                  state->tDense[1], state->xDense + nx, state->xdotDense + nx, t, state->x);
+    state->time = t;
+
+    fmi2Status fmi2Flag = fmu->setTime(state->component, t);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Flag = fmu->setContinuousStates(state->component, state->x, nx);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Flag = sampleOutputs(fmu, state, &state->stepMap);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+    fmi2Flag = fmu->setTime(state->component, state->tDense[1]);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Flag = fmu->setContinuousStates(state->component, state->xDense + nx, nx);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+    state->nSteps++;
+    return fmi2OK;
+}
+
+/**
+ * @brief Performs one communication step with the FMU's own solver.
+ *
+ * The FMU integrates internally from state->time to the next communication
+ * point with a single fmi2DoStep call, instead of the Model Exchange loop.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @return fmi2Status Status of the simulation step
+ */
+static fmi2Status coSimulationDoStep(FMU *fmu, SimulationState *state) {
+    fmi2Status fmi2Flag;
 
-	INFO("Step performed\n");
+    if (!state->eventInfo.terminateSimulation && !state->initialized) {
+        fmi2Flag = fmu->exitInitializationMode(state->component);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        state->initialized = 1;
 
-    // Check for state event
-    for (int i = 0; i < state->nz; i++) {
-        state->prez[i] = state->z[i];
+        // Fixed parameters can no longer change once initialized
+        fmi2Flag = sampleOutputs(fmu, state, &state->constMap);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
     }
-    
-    fmi2Flag = fmu->getEventIndicators(state->component, state->z, state->nz);
+
+    if (state->time >= state->tEnd || state->eventInfo.terminateSimulation) {
+        INFO("Simulation already terminated\n");
+        return fmi2Discard;
+    }
+
+    double hStep = min(state->h, state->tEnd - state->time);
+    PROFILE(&state->profile, PROFILE_DO_STEP,
+            fmi2Flag = fmu->doStep(state->component, state->time, hStep, fmi2True));
+    if (fmi2Flag == fmi2Discard) {
+        // The FMU stopped before the communication point, e.g. to terminate the simulation
+        fmi2Boolean terminated = fmi2True;
+        fmi2Real lastTime = state->time;
+        if (!fmu->getBooleanStatus ||
+            (fmu->getBooleanStatus(state->component, fmi2Terminated, &terminated) <= fmi2Warning && terminated)) {
+            state->eventInfo.terminateSimulation = fmi2True;
+        }
+        if (fmu->getRealStatus &&
+            fmu->getRealStatus(state->component, fmi2LastSuccessfulTime, &lastTime) <= fmi2Warning) {
+            state->time = lastTime;
+        }
+    } else if (fmi2Flag > fmi2Warning) {
+        return fmi2Flag;
+    } else {
+        state->time += hStep;
+    }
+
+    // Update outputs
+    fmi2Flag = sampleOutputs(fmu, state, &state->stepMap);
     if (fmi2Flag > fmi2Warning) return fmi2Flag;
 
+    state->nSteps++;
+    return fmi2OK;
+}
+
+/**
+ * @brief Performs one simulation step and updates the simulation state.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @return fmi2Status Status of the simulation step
+ */
+static fmi2Status simulationStep(FMU *fmu, SimulationState *state) {
+	fmi2Status fmi2Flag;
+    double tNext;
+    fmi2Boolean timeEvent, stateEvent, stepEvent, terminateSimulation;
+
+    // Inputs of the step, taken from the input table
+    if (state->inputRows && state->nSteps < (int)state->nInputRows &&
+        state->time < state->tEnd && !state->eventInfo.terminateSimulation) {
+        fmi2Flag = applyInputs(fmu, state, &state->inputMap,
+                               &state->inputRows[state->nSteps * state->inputMap.nColumns]);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    }
+
+    if (state->coSimulation) {
+        return coSimulationDoStep(fmu, state);
+    }
+
+    // A simulation with the same start values may have stored its initialized state
+    if (!state->eventInfo.terminateSimulation && !state->initialized) {
+        fmi2Flag = warmStartRestore(fmu, state);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    }
+
+    // The FMU is followed through its modes, the component may come from a shared library
+    if (!state->eventInfo.terminateSimulation && !state->initialized) {
+        fmi2Flag = fmu->exitInitializationMode(state->component);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        state->initialized = 1;
+
+        // Initial event iteration
+        state->eventInfo.newDiscreteStatesNeeded = fmi2True;
+        state->eventInfo.terminateSimulation = fmi2False;
+        while (state->eventInfo.newDiscreteStatesNeeded && 
+                !state->eventInfo.terminateSimulation) {
+            PROFILE(&state->profile, PROFILE_DISCRETE_STATES,
+                    fmi2Flag = fmu->newDiscreteStates(state->component, &state->eventInfo));
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        }
+
+        // Fixed parameters can no longer change once initialized
+        fmi2Flag = sampleOutputs(fmu, state, &state->constMap);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+        if (!state->eventInfo.terminateSimulation) {
+            fmi2Flag = fmu->enterContinuousTimeMode(state->component);
+            if (fmi2Flag > fmi2Warning) {
+                INFO("Error entering continuous time mode\n");
+                return fmi2Flag;
+            }
+
+            // Reference values for the state event detection
+            PROFILE(&state->profile, PROFILE_EVENT_INDICATORS,
+                    fmi2Flag = fmu->getEventIndicators(state->component, state->z, state->nz));
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        }
+
+        warmStartSave(fmu, state);
+    }
+
+    INFO("Entering simulation loop\n");
+	if (state->time >= state->tEnd || state->eventInfo.terminateSimulation) {
+        INFO("Simulation already terminated\n");
+		return fmi2Discard;
+    }
+
+    //fmi2Status fmi2Flag;
+
+    // Advance time
+    tNext = min(state->time + state->h, state->tEnd);
+    timeEvent = state->eventInfo.nextEventTimeDefined && 
+                tNext >= state->eventInfo.nextEventTime;
+    
+    if (timeEvent) tNext = state->eventInfo.nextEventTime;
+
+    // With dense output, the internal steps only stop at the time events and at the end
+    double tLimit = tNext;
+    if (state->dense) {
+        tLimit = state->tEnd;
+        if (state->eventInfo.nextEventTimeDefined && state->eventInfo.nextEventTime < tLimit) {
+            tLimit = state->eventInfo.nextEventTime;
+        }
+    }
+
+    // The last internal step of a dense output simulation may already cover tNext
     stateEvent = fmi2False;
-    for (int i = 0; i < state->nz; i++) {
-        stateEvent = stateEvent || (state->prez[i] * state->z[i] < 0);
+    stepEvent = fmi2False;
+    int xdotKnown = 0;
+    if (state->ahead) {
+        if (state->tDense[1] > tNext) return denseSample(fmu, state, tNext);
+        // Go on from the end of the step, where the FMU is, and handle its events
+        state->ahead = 0;
+        state->time = state->tDense[1];
+        stateEvent = state->stateEventAhead;
+        stepEvent = state->stepEventAhead;
+        memcpy(state->xdot, state->xdotDense + state->nx, state->nx * sizeof(double));
+        xdotKnown = 1;
+    }
+
+    // Get current state
+    fmi2Flag = fmu->getContinuousStates(state->component, state->x, state->nx);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+	INFO("States retrieved\n");
+
+    // Integrate up to tNext, the adaptive solvers may need several internal steps
+    double tPre = state->time;
+    while (state->time < tNext && !stateEvent && !stepEvent) {
+        tPre = state->time;
+        // dopri5 evaluated the derivatives at the end of its last step
+        const double *xdotEnd = solverEndDerivatives(&state->solver);
+        if (xdotEnd && !xdotKnown) {
+            memcpy(state->xdot, xdotEnd, state->nx * sizeof(double));
+        } else if (!xdotKnown) {
+            PROFILE(&state->profile, PROFILE_DERIVATIVES,
+                    fmi2Flag = fmu->getDerivatives(state->component, state->xdot, state->nx));
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        }
+        xdotKnown = 0;
+        memcpy(state->xPre, state->x, state->nx * sizeof(double));
+
+        fmi2Flag = solverStep(&state->solver, fmu, state->component, &state->time,
+                              state->x, state->xdot, tLimit);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+		INFO("Step performed\n");
+
+        // Check for state event
+        for (int i = 0; i < state->nz; i++) {
+            state->prez[i] = state->z[i];
+        }
+        
+        PROFILE(&state->profile, PROFILE_EVENT_INDICATORS,
+                fmi2Flag = fmu->getEventIndicators(state->component, state->z, state->nz));
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+        stateEvent = eventIndicatorsCrossed(state->prez, state->z, state->nz);
+        if (stateEvent) {
+            fmi2Flag = locateStateEvent(fmu, state, tPre);
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        }
+
+		INFO("State event checked\n");
+
+        // Check for step event
+        fmi2Flag = fmu->completedIntegratorStep(state->component, fmi2True, 
+                                               &stepEvent, &terminateSimulation);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+        if (terminateSimulation) {
+            state->eventInfo.terminateSimulation = fmi2True;
+            return fmi2OK;
+        }
+
+        // Stop at the internal step where the event occurred
+        if (stateEvent || stepEvent) break;
+    }
+
+    // A dense output step past tNext is kept, its events wait for the output points to reach it
+    if (state->time > tNext) {
+        int nx = state->nx;
+        state->tDense[0] = tPre;
+        state->tDense[1] = state->time;
+        memcpy(state->xDense, state->xPre, nx * sizeof(double));
+        memcpy(state->xDense + nx, state->x, nx * sizeof(double));
+        memcpy(state->xdotDense, state->xdot, nx * sizeof(double));
+        // Locating a state event moved the FMU back from the end of the solver step
+        const double *xdotEnd = solverEndDerivatives(&state->solver);
+        if (xdotEnd && !stateEvent) {
+            memcpy(state->xdotDense + nx, xdotEnd, nx * sizeof(double));
+        } else {
+            PROFILE(&state->profile, PROFILE_DERIVATIVES,
+                    fmi2Flag = fmu->getDerivatives(state->component, state->xdotDense + nx, nx));
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        }
+        state->stateEventAhead = stateEvent;
+        state->stepEventAhead = stepEvent;
+        state->ahead = 1;
+        return denseSample(fmu, state, tNext);
+    }
+    timeEvent = timeEvent && state->time >= tNext;
+
+	INFO("Step event checked\n");
+
+    // Handle events
+    if (timeEvent || stateEvent || stepEvent) {
+        fmi2Flag = fmu->enterEventMode(state->component);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+        if (timeEvent) state->nTimeEvents++;
+        if (stateEvent) state->nStateEvents++;
+        if (stepEvent) state->nStepEvents++;
+		INFO("Event handled\n");
+
+        // Event iteration
+        state->eventInfo.newDiscreteStatesNeeded = fmi2True;
+        state->eventInfo.terminateSimulation = fmi2False;
+        
+        while (state->eventInfo.newDiscreteStatesNeeded && 
+               !state->eventInfo.terminateSimulation) {
+            PROFILE(&state->profile, PROFILE_DISCRETE_STATES,
+                    fmi2Flag = fmu->newDiscreteStates(state->component, &state->eventInfo));
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        }
+
+        if (state->eventInfo.terminateSimulation) {
+            return fmi2OK;
+        }
+
+        // Re-enter continuous-time mode
+        fmi2Flag = fmu->enterContinuousTimeMode(state->component);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+        // The states may have jumped: the step history is no longer valid
+        solverReset(&state->solver);
+
+        // New reference values for the state event detection
+        PROFILE(&state->profile, PROFILE_EVENT_INDICATORS,
+                fmi2Flag = fmu->getEventIndicators(state->component, state->z, state->nz));
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
     }
 
-	INFO("State event checked\n");
+    // Update outputs
+    fmi2Flag = sampleOutputs(fmu, state, &state->stepMap);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+
+    state->nSteps++;
+    return fmi2OK;
+}
+
+/**
+ * @brief Performs one simulation step, counted in the step phase.
+ *
+ * @param fmu Pointer to the FMU structure
+ * @param state Pointer to the simulation state
+ * @return fmi2Status Status of the simulation step
+ */
+fmi2Status simulationDoStep(FMU *fmu, SimulationState *state) {
+    fmi2Status fmi2Flag;
+    Arena *previous = arenaBind(state->arena);
+    PROFILE(&state->profile, PROFILE_STEP, fmi2Flag = simulationStep(fmu, state));
+    arenaBind(previous);
+    return fmi2Flag;
+}
+
+// Algorithme maître des simulations couplées (couple)
+#include "master.c"
+
+
+/**
+ * @brief Returns the index of a variable in get_variables_names(), -1 if there is none.
+ *
+ * The name is looked up in the perfect hash table of the generated model
+ * description, in constant time, or by binary search for a loaded FMU.
+ */
+static int get_variable_index(const FMUModel *fmuModel, const char * name) {
+	if (strcmp(name, "step") == 0) {
+		return 0;
+	}
+	if (fmuModel->findVariable) {
+		int i = fmuModel->findVariable(name);
+		return i < 0 ? -1 : i+1;
+	}
+	int lo = 0, hi = fmuModel->nVariables - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		int i = fmuModel->byName[mid];
+		int cmp = strcmp(name, fmuModel->variables[i].name);
+		if (cmp == 0) return i+1;
+		if (cmp < 0) hi = mid - 1;
+		else lo = mid + 1;
+	}
+	return -1;
+}
+
+/**
+ * @brief Resolves a variable name or index into an index of get_variables_names().
+ *
+ * @param fmuModel Model of the variable
+ * @param var_in A variable name or index
+ * @return The index, 0 designating the step count
+ */
+static int resolve_variable(const FMUModel *fmuModel, mp_obj_t var_in) {
+	int idx;
+	if (mp_obj_is_int(var_in)) {
+		idx = mp_obj_get_int(var_in);
+		if (idx < 0 || idx > fmuModel->nVariables) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Index out of range"));
+		}
+	} else if (mp_obj_is_str(var_in)) {
+		idx = get_variable_index(fmuModel, mp_obj_str_get_str(var_in));
+		if (idx < 0) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Variable not found"));
+		}
+	} else {
+		mp_raise_ValueError(MP_ERROR_TEXT("Invalid argument type"));
+	}
+	return idx;
+}
+
+/**
+ * @brief Resolves a list of variable names or indices into variable indices.
+ *
+ * Indices follow get_variables_names(): 0 is the step count, which is always
+ * recorded and therefore skipped, and i > 0 designates the variable i-1.
+ *
+ * @param fmuModel Model of the variables
+ * @param outputs_in A list or tuple of names and/or indices, or None
+ * @param nOutputs Set to the number of resolved indices
+ * @return An array of variable indices allocated on the MicroPython heap,
+ *         or NULL when outputs_in is None (all variables are recorded).
+ */
+static int *resolve_outputs(const FMUModel *fmuModel, mp_obj_t outputs_in, int *nOutputs) {
+	*nOutputs = 0;
+	if (outputs_in == mp_const_none) {
+		return NULL;
+	}
+
+	size_t len;
+	mp_obj_t *items;
+	mp_obj_get_array(outputs_in, &len, &items);
+	int *outputs = m_new(int, len + 1);
+	for (size_t i = 0; i < len; i++) {
+		int idx = resolve_variable(fmuModel, items[i]);
+		if (idx > 0) {
+			outputs[(*nOutputs)++] = idx - 1;
+		}
+	}
+	return outputs;
+}
+
+/**
+ * @brief Fills the simulation options from the keyword arguments of the module functions.
+ *
+ * @param fmuModel Model to simulate
+ * @param options Pointer to the options to fill
+ * @param outputs_in A list or tuple of names and/or indices, or None for all variables
+ * @param solver_in Name of the integration method: "euler" (default), "rk4",
+ *        "dopri5" (or "rk45") or "bdf"
+ * @param tolerance_in Relative tolerance of the adaptive and implicit methods, or None
+ * @param interface_in FMI interface: "me" for Model Exchange, integrated by the
+ *        solver above, or "cs" for Co-Simulation, where the FMU integrates itself
+ *        with one fmi2DoStep per step. None selects Model Exchange when the FMU has it.
+ * @param dense Interpolate the outputs at each step instead of stopping the
+ *        integrator there, with "dopri5" in Model Exchange
+ */
+static void get_simulation_options(const FMUModel *fmuModel, SimulationOptions *options, mp_obj_t outputs_in,
+                                   mp_obj_t solver_in, mp_obj_t tolerance_in,
+                                   mp_obj_t interface_in, bool dense) {
+	int nOutputs;
+	options->outputs = resolve_outputs(fmuModel, outputs_in, &nOutputs);
+	options->nOutputs = nOutputs;
+
+	options->solver = SOLVER_EULER;
+	if (solver_in != mp_const_none) {
+		qstr solver_name = mp_obj_str_get_qstr(solver_in);
+		if (solver_name == MP_QSTR_rk4) {
+			options->solver = SOLVER_RK4;
+		} else if (solver_name == MP_QSTR_dopri5 || solver_name == MP_QSTR_rk45) {
+			options->solver = SOLVER_DOPRI5;
+		} else if (solver_name == MP_QSTR_bdf) {
+			options->solver = SOLVER_BDF;
+		} else if (solver_name != MP_QSTR_euler) {
+			mp_raise_ValueError(MP_ERROR_TEXT("solver must be 'euler', 'rk4', 'dopri5' or 'bdf'"));
+		}
+	}
+
+	options->tolerance = 1e-6;
+	if (tolerance_in != mp_const_none) {
+		options->tolerance = mp_obj_get_float(tolerance_in);
+		if (options->tolerance <= 0) {
+			mp_raise_ValueError(MP_ERROR_TEXT("tolerance must be positive"));
+		}
+	}
+
+	// An interface is available if it is compiled in and implemented by the FMU
+	options->arena = NULL;
+	options->coSimulation = fmuModel->fmu->enterContinuousTimeMode == NULL;
+	if (interface_in != mp_const_none) {
+		qstr interface_name = mp_obj_str_get_qstr(interface_in);
+		if (interface_name != MP_QSTR_me && interface_name != MP_QSTR_cs) {
+			mp_raise_ValueError(MP_ERROR_TEXT("interface must be 'me' or 'cs'"));
+		}
+		options->coSimulation = interface_name == MP_QSTR_cs;
+	}
+	if (options->coSimulation ? !fmuModel->fmu->doStep : !fmuModel->fmu->enterContinuousTimeMode) {
+		mp_raise_ValueError(MP_ERROR_TEXT("interface not available for this FMU"));
+	}
+
+	// Only "dopri5" interpolates its steps, the other methods step to each output point
+	options->dense = dense;
+	if (dense && (options->coSimulation || options->solver != SOLVER_DOPRI5)) {
+		mp_raise_ValueError(MP_ERROR_TEXT("dense output needs the 'dopri5' solver in Model Exchange"));
+	}
+}
+
+/**
+ * @brief Returns the model of an FMU compiled into the firmware.
+ *
+ * The function tables only hold function pointers: each one is filled once,
+ * from the functions prefixed with the modelIdentifier of the FMU, and shared
+ * by all the simulations.
+ *
+ * @param i Index of the model in compiledModels
+ * @return Pointer to the model, which is never freed
+ */
+static FMUModel *compiled_model(int i) {
+	static FMU fmus[NMODELS];
+	static FMUModel fmuModels[NMODELS];
+	FMUModel *fmuModel = &fmuModels[i];
+	if (!fmuModel->fmu) {
+		const CompiledModel *compiled = &compiledModels[i];
+		if (compiled->loadFunctions(&fmus[i]) != 0) {
+			mp_raise_msg_varg(&mp_type_OSError, MP_ERROR_TEXT("%s: missing FMI functions"), compiled->modelIdentifier);
+		}
+		fmuModel->description = compiled->description;
+		fmuModel->variables = compiled->variables;
+		fmuModel->nVariables = compiled->nVariables;
+		fmuModel->findVariable = compiled->findVariable;
+		fmuModel->fmu = &fmus[i];
+	}
+	return fmuModel;
+}
+
+/**
+ * @brief Returns the default model: the first FMU compiled into the firmware.
+ */
+static FMUModel *builtin_model(void) {
+	return compiled_model(0);
+}
+
+/**
+ * @brief Returns the compiled model with the given modelIdentifier, NULL if there is none.
+ */
+static FMUModel *find_compiled_model(const char *modelIdentifier) {
+	for (int i = 0; i < NMODELS; i++) {
+		if (strcmp(compiledModels[i].modelIdentifier, modelIdentifier) == 0) {
+			return compiled_model(i);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Takes a reference on a model, so that a loaded FMU outlives its users.
+ */
+static FMUModel *model_acquire(FMUModel *fmuModel) {
+	if (fmuModel->loaded) fmuModel->refCount++;
+	return fmuModel;
+}
+
+/**
+ * @brief Releases a reference taken on a model, unloading the FMU with the last one.
+ */
+static void model_release(FMUModel *fmuModel) {
+	#if FMU_DLOPEN
+	if (fmuModel->loaded && --fmuModel->refCount == 0) {
+		unloadFMUModel(fmuModel->loaded);
+	}
+	#else
+	(void)fmuModel;
+	#endif
+}
+
+// Objet Model : FMU chargée par load_fmu()
+typedef struct example_Model_obj_t {
+	mp_obj_base_t base;
+	FMUModel *model;         // NULL once closed
+} example_Model_obj_t;
+
+extern const mp_obj_type_t example_type_Model;
+
+/**
+ * @brief Returns the model designated by the model keyword of the module functions.
+ *
+ * @param model_in A Model returned by load_fmu() or get_model(), the
+ *        modelIdentifier of a compiled FMU, or None for the default one
+ */
+static FMUModel *model_from_obj(mp_obj_t model_in) {
+	if (model_in == mp_const_none) {
+		return builtin_model();
+	}
+	if (mp_obj_is_str(model_in)) {
+		FMUModel *fmuModel = find_compiled_model(mp_obj_str_get_str(model_in));
+		if (!fmuModel) {
+			mp_raise_ValueError(MP_ERROR_TEXT("no compiled model with this name"));
+		}
+		return fmuModel;
+	}
+	if (!mp_obj_is_type(model_in, &example_type_Model)) {
+		mp_raise_TypeError(MP_ERROR_TEXT("expecting a Model"));
+	}
+	example_Model_obj_t *self = MP_OBJ_TO_PTR(model_in);
+	if (!self->model) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Model is closed"));
+	}
+	return self->model;
+}
+
+// Statistics of the real-time mode, in microseconds
+typedef struct {
+    mp_uint_t period;                // step size in wall-clock time
+    mp_uint_t deadline;              // start time of the next step (run_realtime) or of the last tick
+    volatile int pending;            // a step is scheduled and not performed yet (timer mode)
+    size_t nSteps;                   // number of paced steps
+    size_t nOverruns;                // steps that ended after the next deadline, or missed ticks
+    mp_uint_t maxJitter;             // largest delay between a deadline and the start of its step
+    double sumJitter;                // sum of the delays, for their mean
+    mp_uint_t maxStep;               // longest step, callback included
+} RealtimeStats;
+
+// Objet Simulation : possède son instance FMU et ses buffers
+typedef struct example_Simulation_obj_t {
+	mp_obj_base_t base;
+	FMU *fmu;
+	FMUModel *model;         // model of the instance, referenced until the simulation is closed
+	SimulationState *state;
+	RealtimeStats realtime;
+	mp_obj_t stepCallback;   // called after each real-time step, or None
+	mp_obj_t outputBuffer;   // array('d') filled by __next__ instead of a new tuple, or None
+	Arena *arena;            // allocator of the FMU instance, deleted after it, or NULL
+	int busy;                // stepped by the threads of Coupling.run(), which must end first
+} example_Simulation_obj_t;
+
+extern const mp_obj_type_t example_type_Simulation;
+
+// Fonction print, gère Simulation.__repr__ et Simulation.__str__
+static void example_Simulation_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (!self->state) {
+		mp_printf(print, "Simulation(closed)");
+	} else if (kind == PRINT_STR) {
+		mp_printf(print, "Simulation(%f, %f)", self->state->time, self->state->tEnd);
+	} else {
+		mp_printf(print, "%d", self->state->nSteps);
+	}
+}
+
+/**
+ * @brief Creates the arena of an FMU instance from the arena= option.
+ *
+ * The region is allocated on the C heap. Buffers are not accepted: a
+ * bytearray can be resized, which moves its memory while the blocks of the
+ * instance must stay in place, and MicroPython cannot prevent it.
+ *
+ * @param arena_in None or a size in bytes
+ * @return The arena, NULL for None
+ */
+static Arena *arena_from_obj(mp_obj_t arena_in) {
+	if (arena_in == mp_const_none) {
+		return NULL;
+	}
+	if (!mp_obj_is_int(arena_in) || mp_obj_get_int(arena_in) <= 0) {
+		mp_raise_ValueError(MP_ERROR_TEXT("arena must be a positive size"));
+	}
+	Arena *arena = arenaNew((size_t)mp_obj_get_int(arena_in));
+	if (!arena) {
+		mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the arena"));
+	}
+	return arena;
+}
+
+/**
+ * @brief Creates a Simulation object owning a new, initialized FMU instance.
+ *
+ * The object is allocated with a finaliser so that the instance and its buffers
+ * are released when it is garbage collected.
+ *
+ * @param fmuModel Model to instantiate
+ * @param tStart Start time of the simulation
+ * @param tEnd End time of the simulation
+ * @param h Step size
+ * @param options Recorded outputs and integration method
+ * @param arena_in arena= option, see arena_from_obj()
+ * @return The new Simulation object
+ */
+static example_Simulation_obj_t *simulation_new(FMUModel *fmuModel, double tStart, double tEnd, double h,
+                                                const SimulationOptions *options, mp_obj_t arena_in) {
+	if (h <= 0 || tEnd < tStart) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Invalid simulation interval"));
+	}
+	example_Simulation_obj_t *self = mp_obj_malloc_with_finaliser(example_Simulation_obj_t, &example_type_Simulation);
+	self->fmu = fmuModel->fmu;
+	self->model = NULL;
+	memset(&self->realtime, 0, sizeof(RealtimeStats));
+	self->stepCallback = mp_const_none;
+	self->outputBuffer = mp_const_none;
+	self->state = NULL;
+	self->busy = 0;
+	self->arena = NULL;
+	self->arena = arena_from_obj(arena_in);
+	SimulationOptions instanceOptions = *options;
+	instanceOptions.arena = self->arena;
+	self->state = initializeSimulation(fmuModel, tStart, tEnd, h, &instanceOptions);
+	if (!self->state) {
+		mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to initialize the simulation"));
+	}
+	self->model = model_acquire(fmuModel);
+	return self;
+}
+
+/**
+ * @brief Raises a RuntimeError while the threads of Coupling.run() step a simulation.
+ */
+static void simulation_check_idle(const example_Simulation_obj_t *self) {
+	if (self->busy) {
+		mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Simulation is busy"));
+	}
+}
+
+/**
+ * @brief Returns the simulation state of an open Simulation object not being run by a Coupling.
+ */
+static SimulationState *simulation_get_state(mp_obj_t self_in) {
+	if (!mp_obj_is_type(self_in, &example_type_Simulation)) {
+		mp_raise_TypeError(MP_ERROR_TEXT("expecting a Simulation"));
+	}
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (!self->state) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Simulation is closed"));
+	}
+	simulation_check_idle(self);
+	return self->state;
+}
+
+/**
+ * @brief Returns whether the simulation reached its end time or was terminated by the FMU.
+ */
+static int simulation_finished(const SimulationState *state) {
+	return state->time >= state->tEnd || state->eventInfo.terminateSimulation;
+}
+
+/**
+ * @brief Performs one simulation step, raising a RuntimeError if the FMU fails.
+ */
+static void simulation_step(example_Simulation_obj_t *self) {
+	fmi2Status status = simulationDoStep(self->fmu, self->state);
+	if (status > fmi2Discard) {
+		mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Simulation step failed: %s"),
+		                  fmi2StatusToString(status));
+	}
+}
+
+/**
+ * @brief Frees the FMU instance, the buffers and the arena of a Simulation, without raising.
+ */
+static void simulation_free(example_Simulation_obj_t *self) {
+	if (self->state) {
+		cleanupSimulation(self->fmu, self->state);
+		self->state = NULL;
+		self->stepCallback = mp_const_none;
+		self->outputBuffer = mp_const_none;
+	}
+	if (self->arena) {
+		arenaDelete(self->arena);
+		self->arena = NULL;
+	}
+	if (self->model) {
+		model_release(self->model);
+		self->model = NULL;
+	}
+}
+
+// Simulation.__del__ : finaliser du ramasse-miettes, ne lève jamais d'exception
+static mp_obj_t example_Simulation_del(mp_obj_t self_in) {
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	// A busy simulation is still referenced by its Coupling and cannot be
+	// collected; should it be anyway, its instance is left to the threads
+	if (!self->busy) {
+		simulation_free(self);
+	}
+	return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Simulation_del_obj, example_Simulation_del);
+
+// Simulation.close() : libère l'instance FMU et les buffers, erreur si un Coupling la fait avancer
+static mp_obj_t example_Simulation_close(mp_obj_t self_in) {
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	simulation_check_idle(self);
+	simulation_free(self);
+	return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Simulation_close_obj, example_Simulation_close);
+
+// Simulation.snapshot() : renvoie l'état de la simulation sous forme de bytes
+static mp_obj_t example_Simulation_snapshot(mp_obj_t self_in) {
+	SimulationState *state = simulation_get_state(self_in);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	size_t size;
+	Arena *previous = arenaBind(state->arena);
+	fmi2Status status = takeSnapshot(self->fmu, state, &size);
+	arenaBind(previous);
+	if (status > fmi2Warning) {
+		mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Snapshot failed: %s"),
+		                  fmi2StatusToString(status));
+	}
+	vstr_t vstr;
+	vstr_init_len(&vstr, size);
+	status = writeSnapshot(self->fmu, state, (fmi2Byte *)vstr.buf, size);
+	if (status > fmi2Warning) {
+		vstr_clear(&vstr);
+		mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Snapshot failed: %s"),
+		                  fmi2StatusToString(status));
+	}
+	return mp_obj_new_bytes_from_vstr(&vstr);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Simulation_snapshot_obj, example_Simulation_snapshot);
+
+// Simulation.restore(snapshot) : revient à l'état renvoyé par snapshot()
+static mp_obj_t example_Simulation_restore(mp_obj_t self_in, mp_obj_t snapshot_in) {
+	SimulationState *state = simulation_get_state(self_in);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	mp_buffer_info_t bufinfo;
+	mp_get_buffer_raise(snapshot_in, &bufinfo, MP_BUFFER_READ);
+	if (!isValidSnapshot(state, bufinfo.buf, bufinfo.len)) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Invalid snapshot"));
+	}
+	Arena *previous = arenaBind(state->arena);
+	fmi2Status status = restoreSnapshot(self->fmu, state, bufinfo.buf);
+	arenaBind(previous);
+	if (status > fmi2Warning) {
+		mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Restore failed: %s"),
+		                  fmi2StatusToString(status));
+	}
+	return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(example_Simulation_restore_obj, example_Simulation_restore);
+
+/**
+ * @brief Returns the microseconds from a to b of mp_hal_ticks_us(), negative if b is before a.
+ *
+ * The ticks wrap around at the width of mp_uint_t.
+ */
+static mp_int_t ticks_diff_us(mp_uint_t a, mp_uint_t b) {
+	return (mp_int_t)(b - a);
+}
+
+/**
+ * @brief Performs one real-time step started late by jitter microseconds and updates the statistics.
+ *
+ * @return The time at which the step, callback included, ended
+ */
+static mp_uint_t realtime_step(example_Simulation_obj_t *self, mp_uint_t jitter) {
+	RealtimeStats *rt = &self->realtime;
+	mp_uint_t start = mp_hal_ticks_us();
+	simulation_step(self);
+	if (self->stepCallback != mp_const_none) {
+		mp_call_function_1(self->stepCallback, MP_OBJ_FROM_PTR(self));
+	}
+	mp_uint_t end = mp_hal_ticks_us();
+	mp_uint_t duration = (mp_uint_t)ticks_diff_us(start, end);
+	rt->nSteps++;
+	rt->sumJitter += jitter;
+	if (jitter > rt->maxJitter) rt->maxJitter = jitter;
+	if (duration > rt->maxStep) rt->maxStep = duration;
+	return end;
+}
+
+/**
+ * @brief Resets the real-time statistics of a simulation.
+ */
+static void realtime_reset(example_Simulation_obj_t *self, double scale) {
+	if (scale <= 0) {
+		mp_raise_ValueError(MP_ERROR_TEXT("scale must be positive"));
+	}
+	memset(&self->realtime, 0, sizeof(RealtimeStats));
+	self->realtime.period = (mp_uint_t)(self->state->h * 1e6 / scale + 0.5);
+}
+
+/**
+ * @brief Runs a simulation in sync with the wall clock.
+ *
+ * Simulation.run_realtime(steps=-1, scale=1.0, callback=None)
+ *
+ * Step k starts k * StepSize / scale seconds after the call, measured with
+ * mp_hal_ticks_us(). In between, the thread sleeps in mp_event_wait_ms(),
+ * which keeps running scheduled callbacks and pending events, then polls
+ * them during the last millisecond. A step that
+ * ends after the start of the next one counts as an overrun and the schedule
+ * restarts from its end instead of catching up.
+ *
+ * @param steps Maximum number of steps, -1 to run until the end time
+ * @param scale Simulated seconds per wall-clock second
+ * @param callback Called with the Simulation after each step, for the I/O
+ * @return The number of steps performed
+ */
+static mp_obj_t example_Simulation_run_realtime(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_self, ARG_steps, ARG_scale, ARG_callback };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_self, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_steps, MP_ARG_INT, {.u_int = -1} },
+		{ MP_QSTR_scale, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_callback, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	simulation_get_state(args[ARG_self].u_obj);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(args[ARG_self].u_obj);
+	double scale = args[ARG_scale].u_obj == mp_const_none ? 1.0 : mp_obj_get_float(args[ARG_scale].u_obj);
+	realtime_reset(self, scale);
+	self->stepCallback = args[ARG_callback].u_obj;
+	RealtimeStats *rt = &self->realtime;
+
+	mp_int_t steps = args[ARG_steps].u_int;
+	mp_int_t k = 0;
+	rt->deadline = mp_hal_ticks_us();
+	for (; (steps < 0 || k < steps) && self->state && !simulation_finished(self->state); k++) {
+		mp_int_t remaining;
+		while ((remaining = ticks_diff_us(mp_hal_ticks_us(), rt->deadline)) > 0) {
+			// Wake up a millisecond early, the sleep being only ms-accurate
+			if (remaining >= 2000) {
+				mp_event_wait_ms(remaining / 1000 - 1);
+			} else {
+				mp_event_handle_nowait();
+			}
+		}
+		mp_uint_t end = realtime_step(self, (mp_uint_t)(-remaining));
+		rt->deadline += rt->period;
+		if (ticks_diff_us(rt->deadline, end) > 0) {
+			rt->nOverruns++;
+			rt->deadline = end;
+		}
+	}
+	self->stepCallback = mp_const_none;
+	return mp_obj_new_int(k);
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_Simulation_run_realtime_obj, 1, example_Simulation_run_realtime);
+
+#if MICROPY_ENABLE_SCHEDULER
+// Step scheduled by Simulation.tick(), run outside of the interrupt
+static mp_obj_t example_Simulation_scheduled_step(mp_obj_t self_in) {
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	RealtimeStats *rt = &self->realtime;
+	mp_uint_t jitter = (mp_uint_t)ticks_diff_us(rt->deadline, mp_hal_ticks_us());
+	if (self->state && !self->busy && !simulation_finished(self->state)) {
+		// pending stays set during the step and is cleared even if the step raises
+		nlr_buf_t nlr;
+		if (nlr_push(&nlr) == 0) {
+			realtime_step(self, jitter);
+			nlr_pop();
+		} else {
+			rt->pending = 0;
+			nlr_jump(nlr.ret_val);
+		}
+	}
+	rt->pending = 0;
+	return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Simulation_scheduled_step_obj, example_Simulation_scheduled_step);
+
+/**
+ * @brief Schedules one step with mp_sched_schedule(), to be called from a machine.Timer callback.
+ *
+ * Simulation.tick(timer=None)
+ *
+ * Allocates nothing, so it can run in a hard interrupt. A tick arriving while
+ * the step of the previous one is still pending counts as an overrun and is
+ * dropped.
+ *
+ * @return True if a step was scheduled
+ */
+static mp_obj_t example_Simulation_tick(size_t n_args, const mp_obj_t *args) {
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+	RealtimeStats *rt = &self->realtime;
+	if (!self->state || self->busy || simulation_finished(self->state)) {
+		return mp_const_false;
+	}
+	if (rt->pending) {
+		rt->nOverruns++;
+		return mp_const_false;
+	}
+	rt->pending = 1;
+	rt->deadline = mp_hal_ticks_us();
+	if (!mp_sched_schedule(MP_OBJ_FROM_PTR(&example_Simulation_scheduled_step_obj), args[0])) {
+		rt->pending = 0;
+		rt->nOverruns++;
+		return mp_const_false;
+	}
+	return mp_const_true;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_Simulation_tick_obj, 1, 2, example_Simulation_tick);
+
+/**
+ * @brief Prepares a simulation to be stepped by a machine.Timer.
+ *
+ * Simulation.timer_callback(callback=None)
+ *
+ * Resets the real-time statistics and returns the bound tick() method, to be
+ * passed to Timer.init(callback=...), e.g. with period=StepSize in ms.
+ *
+ * @param callback Called with the Simulation after each step, for the I/O
+ * @return The bound Simulation.tick method
+ */
+static mp_obj_t example_Simulation_timer_callback(size_t n_args, const mp_obj_t *args) {
+	simulation_get_state(args[0]);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+	realtime_reset(self, 1.0);
+	self->stepCallback = n_args > 1 ? args[1] : mp_const_none;
+	return mp_obj_new_bound_meth(MP_OBJ_FROM_PTR(&example_Simulation_tick_obj), args[0]);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_Simulation_timer_callback_obj, 1, 2, example_Simulation_timer_callback);
+#endif
+
+// Simulation.realtime_stats() : pas, dépassements et gigue (en µs) du mode temps réel
+static mp_obj_t example_Simulation_realtime_stats(mp_obj_t self_in) {
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	const RealtimeStats *rt = &self->realtime;
+	mp_obj_t stats = mp_obj_new_dict(6);
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_period_us), mp_obj_new_int_from_uint(rt->period));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_steps), mp_obj_new_int_from_uint(rt->nSteps));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_overruns), mp_obj_new_int_from_uint(rt->nOverruns));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_max_jitter_us), mp_obj_new_int_from_uint(rt->maxJitter));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_mean_jitter_us),
+	                  mp_obj_new_float(rt->nSteps ? rt->sumJitter / rt->nSteps : 0.0));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_max_step_us), mp_obj_new_int_from_uint(rt->maxStep));
+	return stats;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Simulation_realtime_stats_obj, example_Simulation_realtime_stats);
+
+/**
+ * @brief Returns the (step, outputs...) tuple of the current step.
+ *
+ * The items are written in the tuple itself, without a temporary array.
+ */
+static mp_obj_t get_output_tuple(SimulationState* state) {
+	mp_obj_tuple_t *tuple;
+	PROFILE(&state->profile, PROFILE_BOXING, {
+		tuple = MP_OBJ_TO_PTR(mp_obj_new_tuple(state->nOutputs+1, NULL));
+		tuple->items[0] = mp_obj_new_int(state->nSteps);
+		for (int i = 0; i < state->nOutputs; i++) {
+			tuple->items[i+1] = mp_obj_new_float(state->output[i]);
+		}
+	});
+	return MP_OBJ_FROM_PTR(tuple);
+}
+
+/**
+ * @brief Writes the step count and the outputs of the current step into an array('d').
+ *
+ * The buffer is looked up at each step, so the array may be replaced or
+ * resized between steps. Nothing is allocated.
+ */
+static mp_obj_t fill_output_buffer(SimulationState *state, mp_obj_t buffer) {
+	mp_buffer_info_t bufinfo;
+	mp_get_buffer_raise(buffer, &bufinfo, MP_BUFFER_WRITE);
+	if (bufinfo.typecode != 'd' || bufinfo.len < (state->nOutputs + 1) * sizeof(double)) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Expecting an array('d') of one value per output and the step"));
+	}
+	double *row = (double*)bufinfo.buf;
+	PROFILE(&state->profile, PROFILE_BOXING, {
+		row[0] = state->nSteps;
+		memcpy(row + 1, state->output, state->nOutputs * sizeof(double));
+	});
+	return buffer;
+}
+
+/**
+ * @brief Selects what the iteration of a simulation returns.
+ *
+ * Simulation.into(buffer)
+ *
+ * With an array('d') of at least 1 + outputs values, each step writes
+ * (step, outputs...) into the array and returns it, instead of allocating a
+ * tuple and a float per output: stepping no longer uses the heap.
+ *
+ * @param buffer An array('d'), or None to get tuples again
+ * @return The Simulation, to iterate over: for row in sim.into(buf)
+ */
+static mp_obj_t example_Simulation_into(mp_obj_t self_in, mp_obj_t buffer_in) {
+	SimulationState *state = simulation_get_state(self_in);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (buffer_in != mp_const_none) {
+		mp_buffer_info_t bufinfo;
+		mp_get_buffer_raise(buffer_in, &bufinfo, MP_BUFFER_WRITE);
+		if (bufinfo.typecode != 'd' || bufinfo.len < (state->nOutputs + 1) * sizeof(double)) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Expecting an array('d') of one value per output and the step"));
+		}
+	}
+	self->outputBuffer = buffer_in;
+	return self_in;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(example_Simulation_into_obj, example_Simulation_into);
+
+/**
+ * @brief Returns the counters of a simulation.
+ *
+ * Simulation.stats(reset=False)
+ *
+ * Each phase maps to a (calls, time in µs) tuple: "step" for whole steps,
+ * "derivatives", "event_indicators", "discrete_states" and "do_step" for the
+ * FMU calls, "sampling" for reading the outputs and "boxing" for converting
+ * them into Python objects. The time spent in the solver and the simulator is
+ * the step time minus the FMU calls and the sampling. The calls are always
+ * counted, the times only in a build with FMU_PROFILE=1 and zero otherwise. With
+ * an arena, "arena" gives its (size, used, peak, fallbacks) in bytes and
+ * calloc() blocks.
+ *
+ * @param reset Zero the phases once read
+ * @return A dict of the phases and of the step, event and solver counts
+ */
+static mp_obj_t example_Simulation_stats(size_t n_args, const mp_obj_t *args) {
+	SimulationState *state = simulation_get_state(args[0]);
+	static const qstr phases[PROFILE_PHASES] = {
+		MP_QSTR_step, MP_QSTR_derivatives, MP_QSTR_event_indicators, MP_QSTR_discrete_states,
+		MP_QSTR_do_step, MP_QSTR_sampling, MP_QSTR_boxing,
+	};
+	mp_obj_t stats = mp_obj_new_dict(PROFILE_PHASES + 7);
+	for (int i = 0; i < PROFILE_PHASES; i++) {
+		mp_obj_t item[2] = {
+			mp_obj_new_int_from_uint(state->profile.calls[i]),
+			mp_obj_new_float((double)state->profile.time[i] / PROFILE_TICKS_PER_US),
+		};
+		mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(phases[i]), mp_obj_new_tuple(2, item));
+	}
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_steps), mp_obj_new_int(state->nSteps));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_time_events), mp_obj_new_int(state->nTimeEvents));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_state_events), mp_obj_new_int(state->nStateEvents));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_step_events), mp_obj_new_int(state->nStepEvents));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_rejected_steps), mp_obj_new_int(state->solver.nRejected));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_jacobians), mp_obj_new_int(state->solver.nJacobians));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_colours), mp_obj_new_int(state->solver.nColours));
+	if (state->arena) {
+		const Arena *arena = state->arena;
+		mp_obj_t item[4] = {
+			mp_obj_new_int_from_uint(arena->size),
+			mp_obj_new_int_from_uint(arena->used),
+			mp_obj_new_int_from_uint(arena->peak),
+			mp_obj_new_int_from_uint(arena->nFallbacks),
+		};
+		mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_arena), mp_obj_new_tuple(4, item));
+	}
+	if (n_args > 1 && mp_obj_is_true(args[1])) {
+		memset(&state->profile, 0, sizeof(Profile));
+	}
+	return stats;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_Simulation_stats_obj, 1, 2, example_Simulation_stats);
+
+// Layout of the results returned by simulate()
+typedef enum {
+    RESULT_TUPLES,                   // list of (step, outputs...) tuples
+    RESULT_COLUMNS,                  // one memoryview('d') per column
+    RESULT_ROWS                      // one row-major memoryview('d')
+} ResultLayout;
+
+// Structure to hold preallocated simulation results
+typedef struct {
+    ResultLayout layout;
+    size_t nColumns;                 // step + one column per output
+    size_t nRows;                    // number of recorded steps
+    size_t capacity;                 // number of rows allocated
+    double *rows;                    // row-major storage (RESULT_ROWS)
+    double **columns;                // column storage (RESULT_COLUMNS)
+} ResultBuffer;
+
+/**
+ * @brief Allocates the storage of a result buffer on the MicroPython heap.
+ *
+ * The number of rows is estimated from the simulation horizon, so a run
+ * without time events never needs to grow the buffer.
+ *
+ * @param buf Pointer to the result buffer to initialize
+ * @param layout Requested result layout
+ * @param nColumns Number of values recorded per step
+ * @param tStart Start time of the simulation
+ * @param tEnd End time of the simulation
+ * @param h Step size
+ */
+static void result_buffer_init(ResultBuffer *buf, ResultLayout layout, size_t nColumns,
+                               double tStart, double tEnd, double h) {
+    buf->layout = layout;
+    buf->nColumns = nColumns;
+    buf->nRows = 0;
+    buf->capacity = (size_t)((tEnd - tStart) / h + 0.5) + 2;
+    buf->rows = NULL;
+    buf->columns = NULL;
+
+    if (layout == RESULT_ROWS) {
+        buf->rows = m_new(double, buf->capacity * nColumns);
+    } else if (layout == RESULT_COLUMNS) {
+        buf->columns = m_new(double *, nColumns);
+        for (size_t j = 0; j < nColumns; j++) {
+            buf->columns[j] = m_new(double, buf->capacity);
+        }
+    }
+}
+
+/**
+ * @brief Copies the current step and outputs of the simulation into the buffer.
+ *
+ * The storage is doubled when full, which only happens when time events
+ * shorten some steps.
+ *
+ * @param buf Pointer to the result buffer
+ * @param state Pointer to the simulation state
+ */
+static void result_buffer_append(ResultBuffer *buf, const SimulationState *state) {
+    if (buf->nRows == buf->capacity) {
+        size_t capacity = buf->capacity * 2;
+        if (buf->layout == RESULT_ROWS) {
+            buf->rows = m_renew(double, buf->rows, buf->capacity * buf->nColumns,
+                                capacity * buf->nColumns);
+        } else {
+            for (size_t j = 0; j < buf->nColumns; j++) {
+                buf->columns[j] = m_renew(double, buf->columns[j], buf->capacity, capacity);
+            }
+        }
+        buf->capacity = capacity;
+    }
+
+    if (buf->layout == RESULT_ROWS) {
+        double *row = &buf->rows[buf->nRows * buf->nColumns];
+        row[0] = (double)state->nSteps;
+        memcpy(&row[1], state->output, (buf->nColumns - 1) * sizeof(double));
+    } else {
+        buf->columns[0][buf->nRows] = (double)state->nSteps;
+        for (size_t j = 1; j < buf->nColumns; j++) {
+            buf->columns[j][buf->nRows] = state->output[j-1];
+        }
+    }
+    buf->nRows++;
+}
+
+/**
+ * @brief Wraps the recorded results into memoryviews without copying them.
+ *
+ * @param buf Pointer to the result buffer
+ * @return A memoryview('d') of nRows * nColumns values for RESULT_ROWS,
+ *         or a tuple of nColumns memoryview('d') for RESULT_COLUMNS.
+ */
+static mp_obj_t result_buffer_to_obj(ResultBuffer *buf) {
+    if (buf->layout == RESULT_ROWS) {
+        return mp_obj_new_memoryview('d', buf->nRows * buf->nColumns, buf->rows);
+    }
+    mp_obj_tuple_t *columns = MP_OBJ_TO_PTR(mp_obj_new_tuple(buf->nColumns, NULL));
+    for (size_t j = 0; j < buf->nColumns; j++) {
+        columns->items[j] = mp_obj_new_memoryview('d', buf->nRows, buf->columns[j]);
+    }
+    m_del(double *, buf->columns, buf->nColumns);
+    return MP_OBJ_FROM_PTR(columns);
+}
+
+// Fonction "itérable" appelée pour obtenir le prochain élément
+static mp_obj_t simulation_next(mp_obj_t self_in) {
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (!self->state) {
+		return mp_make_stop_iteration(MP_OBJ_NULL);
+	}
+	simulation_check_idle(self);
+
+	simulation_step(self);
+
+	if (simulation_finished(self->state)) {
+		return mp_make_stop_iteration(MP_OBJ_NULL); // Signal de fin
+	}
+
+	if (self->outputBuffer != mp_const_none) {
+		return fill_output_buffer(self->state, self->outputBuffer);
+	}
+	return get_output_tuple(self->state);
+} 
+
+static const mp_rom_map_elem_t example_Simulation_locals_dict_table[] = {
+	{ MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&example_Simulation_del_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&example_Simulation_close_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_snapshot), MP_ROM_PTR(&example_Simulation_snapshot_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_restore), MP_ROM_PTR(&example_Simulation_restore_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_into), MP_ROM_PTR(&example_Simulation_into_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&example_Simulation_stats_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_run_realtime), MP_ROM_PTR(&example_Simulation_run_realtime_obj) },
+	#if MICROPY_ENABLE_SCHEDULER
+	{ MP_ROM_QSTR(MP_QSTR_tick), MP_ROM_PTR(&example_Simulation_tick_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_timer_callback), MP_ROM_PTR(&example_Simulation_timer_callback_obj) },
+	#endif
+	{ MP_ROM_QSTR(MP_QSTR_realtime_stats), MP_ROM_PTR(&example_Simulation_realtime_stats_obj) },
+};
+static MP_DEFINE_CONST_DICT(example_Simulation_locals_dict, example_Simulation_locals_dict_table);
+
+// Définition du type
+MP_DEFINE_CONST_OBJ_TYPE(
+	example_type_Simulation,
+	MP_QSTR_Simulation,
+	MP_TYPE_FLAG_ITER_IS_ITERNEXT,
+	print, example_Simulation_print,
+	iter, simulation_next,
+	locals_dict, &example_Simulation_locals_dict
+	);
+
+
+/**
+ * @brief Wrapper function for MicroPython to simulate the FMU model.
+ *
+ * This function serves as a MicroPython interface to the `simulate` function,
+ * allowing users to run simulations from within a MicroPython environment.
+ *
+ * @param start_time The start time of the simulation as a MicroPython object.
+ * @param end_time The end time of the simulation as a MicroPython object.
+ * @param step_size The step size for the simulation as a MicroPython object.
+ * @param outputs Optional keyword listing the names or indices of the variables
+ *        to record, all variables being recorded by default.
+ * @param solver Optional keyword naming the integration method: "euler" (default),
+ *        "rk4", "dopri5" or "bdf".
+ * @param tolerance Optional keyword giving the relative tolerance of "dopri5" and "bdf".
+ * @param dense Optional keyword: with "dopri5", the outputs are interpolated
+ *        at each step instead of stopping the integrator there.
+ * @param layout Optional keyword selecting how results are returned:
+ *        None (default) for a list of (step, outputs...) tuples,
+ *        "columns" for a tuple of one memoryview('d') per column,
+ *        "rows" for a single row-major memoryview('d').
+ * @return The simulation results in the requested layout.
+ *
+ * The function performs the following steps:
+ * 1. Converts the MicroPython objects `start_time`, `end_time` and `step_size` to double values.
+ * 2. Loads the FMU functions.
+ * 3. Initializes the simulation and preallocates the result buffer if requested.
+ * 4. Steps the simulation until the end time, recording each step.
+ * 5. Returns the recorded results.
+ *
+ * With the "columns" and "rows" layouts, a run allocates O(variables) objects
+ * instead of O(steps * variables).
+ */
+static mp_obj_t example_simulate(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_start_time, ARG_end_time, ARG_step_size, ARG_outputs, ARG_solver, ARG_tolerance, ARG_interface, ARG_dense, ARG_model, ARG_layout, ARG_arena };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_start_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_end_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_step_size, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_outputs, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_solver, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_tolerance, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_interface, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_dense, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+		{ MP_QSTR_model, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_layout, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_arena, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	double tStart = mp_obj_get_float(args[ARG_start_time].u_obj);
+	double tEnd = mp_obj_get_float(args[ARG_end_time].u_obj);
+	double h = mp_obj_get_float(args[ARG_step_size].u_obj);
+
+	ResultLayout layout = RESULT_TUPLES;
+	if (args[ARG_layout].u_obj != mp_const_none) {
+		qstr layout_name = mp_obj_str_get_qstr(args[ARG_layout].u_obj);
+		if (layout_name == MP_QSTR_columns) {
+			layout = RESULT_COLUMNS;
+		} else if (layout_name == MP_QSTR_rows) {
+			layout = RESULT_ROWS;
+		} else {
+			mp_raise_ValueError(MP_ERROR_TEXT("layout must be None, 'columns' or 'rows'"));
+		}
+	}
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	SimulationOptions options;
+	get_simulation_options(fmuModel, &options, args[ARG_outputs].u_obj, args[ARG_solver].u_obj,
+	                       args[ARG_tolerance].u_obj, args[ARG_interface].u_obj, args[ARG_dense].u_bool);
+
+	// The instance is released by the finaliser if an exception interrupts the run
+	example_Simulation_obj_t *sim = simulation_new(fmuModel, tStart, tEnd, h, &options, args[ARG_arena].u_obj);
+	SimulationState *state = sim->state;
+	mp_obj_t result;
+
+	if (layout == RESULT_TUPLES) {
+		result = mp_obj_new_list(0, NULL);
+		while (!simulation_finished(state)) {
+			simulation_step(sim);
+			mp_obj_list_append(result, get_output_tuple(state));
+		}
+	} else {
+		ResultBuffer buf;
+		result_buffer_init(&buf, layout, state->nOutputs + 1, tStart, tEnd, h);
+		while (!simulation_finished(state)) {
+			simulation_step(sim);
+			result_buffer_append(&buf, state);
+		}
+		result = result_buffer_to_obj(&buf);
+	}
+
+	simulation_free(sim);
+	return result;
+}
+
+/**
+ * @brief Writes a batch of records to a stream and flushes it.
+ *
+ * Streams without a flush operation, such as sockets, are written unbuffered
+ * and the flush is skipped.
+ *
+ * @param stream The stream object
+ * @param stream_p The stream protocol of the object
+ * @param records The records to write
+ * @param size Size of the records in bytes
+ */
+static void stream_write_records(mp_obj_t stream, const mp_stream_p_t *stream_p,
+                                 const double *records, size_t size) {
+	int errcode;
+	mp_stream_write_exactly(stream, records, size, &errcode);
+	if (errcode != 0) {
+		mp_raise_OSError(errcode);
+	}
+	if (stream_p->ioctl != NULL &&
+	    stream_p->ioctl(stream, MP_STREAM_FLUSH, 0, &errcode) == MP_STREAM_ERROR &&
+	    errcode != MP_EINVAL) {
+		mp_raise_OSError(errcode);
+	}
+}
+
+/**
+ * @brief Simulates the FMU model and writes the results to a stream.
+ *
+ * Each step is written as one fixed-size record of native doubles:
+ * (step, time, outputs...). Records are gathered in a buffer of flush_every
+ * records, written and flushed when it is full, so memory use does not depend
+ * on the length of the run. Any object implementing the stream write protocol
+ * can be used: files opened in binary mode, sockets, io.BytesIO...
+ *
+ * @param stream The stream the records are written to.
+ * @param start_time The start time of the simulation.
+ * @param end_time The end time of the simulation.
+ * @param step_size The step size of the simulation.
+ * @param outputs Optional keyword listing the names or indices of the variables
+ *        to record, all variables being recorded by default.
+ * @param solver Optional keyword naming the integration method: "euler" (default),
+ *        "rk4", "dopri5" or "bdf".
+ * @param tolerance Optional keyword giving the relative tolerance of "dopri5" and "bdf".
+ * @param dense Optional keyword: with "dopri5", the outputs are interpolated
+ *        at each step instead of stopping the integrator there.
+ * @param flush_every Optional keyword giving the number of records written per
+ *        batch, 64 by default.
+ * @return The number of records written.
+ */
+static mp_obj_t example_simulate_to(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_stream, ARG_start_time, ARG_end_time, ARG_step_size, ARG_outputs, ARG_solver, ARG_tolerance, ARG_interface, ARG_dense, ARG_model, ARG_flush_every, ARG_arena };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_stream, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_start_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_end_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_step_size, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_outputs, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_solver, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_tolerance, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_interface, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_dense, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+		{ MP_QSTR_model, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_flush_every, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 64} },
+		{ MP_QSTR_arena, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	mp_obj_t stream = args[ARG_stream].u_obj;
+	const mp_stream_p_t *stream_p = mp_get_stream_raise(stream, MP_STREAM_OP_WRITE);
+	double tStart = mp_obj_get_float(args[ARG_start_time].u_obj);
+	double tEnd = mp_obj_get_float(args[ARG_end_time].u_obj);
+	double h = mp_obj_get_float(args[ARG_step_size].u_obj);
+	if (args[ARG_flush_every].u_int <= 0) {
+		mp_raise_ValueError(MP_ERROR_TEXT("flush_every must be positive"));
+	}
+	size_t nBatch = args[ARG_flush_every].u_int;
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	SimulationOptions options;
+	get_simulation_options(fmuModel, &options, args[ARG_outputs].u_obj, args[ARG_solver].u_obj,
+	                       args[ARG_tolerance].u_obj, args[ARG_interface].u_obj, args[ARG_dense].u_bool);
+
+	example_Simulation_obj_t *sim = simulation_new(fmuModel, tStart, tEnd, h, &options, args[ARG_arena].u_obj);
+	SimulationState *state = sim->state;
+	size_t nColumns = state->nOutputs + 2;
+	double *records = m_new(double, nBatch * nColumns);
+	size_t nRecords = 0, nWritten = 0;
+
+	while (!simulation_finished(state)) {
+		simulation_step(sim);
+		double *record = &records[nRecords * nColumns];
+		record[0] = (double)state->nSteps;
+		record[1] = state->time;
+		memcpy(&record[2], state->output, state->nOutputs * sizeof(double));
+		if (++nRecords == nBatch) {
+			stream_write_records(stream, stream_p, records, nRecords * nColumns * sizeof(double));
+			nWritten += nRecords;
+			nRecords = 0;
+		}
+	}
+	if (nRecords > 0) {
+		stream_write_records(stream, stream_p, records, nRecords * nColumns * sizeof(double));
+		nWritten += nRecords;
+	}
+
+	m_del(double, records, nBatch * nColumns);
+	simulation_free(sim);
+	return mp_obj_new_int_from_uint(nWritten);
+}
+
+// Start value set before a simulation of the sweep
+typedef struct {
+    fmi2ValueReference vr;
+    VarType type;
+    double value;
+} SweepParam;
+
+// Structure to hold one run of a parameter sweep
+typedef struct {
+    const SweepParam *params;        // start values of the run
+    int nParams;                     // number of start values
+    double *rows;                    // row-major results, preallocated on the MicroPython heap
+    size_t capacity;                 // number of rows allocated
+    size_t nRows;                    // number of recorded steps
+    int spilled;                     // rows was moved to the C heap to grow it
+    fmi2Status status;               // worst status returned by the FMU
+} SweepRun;
+
+// Structure shared by the workers of a parameter sweep
+typedef struct {
+    FMUModel *model;                 // referenced until the end of the sweep
+    SimulationOptions options;       // copied so that workers never read the caller's stack
+    size_t arenaSize;                // size of the arena of each worker, 0 for none
+    double tStart;
+    double tEnd;
+    double h;
+    size_t nColumns;                 // step + one column per output
+    SweepRun *runs;
+    size_t nRuns;
+    size_t nextRun;                  // next run to hand out, protected by monitor
+    #if MICROPY_PY_THREAD
+    int nActive;                     // number of started workers still running, protected by monitor
+    Monitor monitor;
+    #endif
+} SweepContext;
+
+/**
+ * @brief Appends the current step and outputs of a simulation to the results of a run.
+ *
+ * Runs on the worker threads, which must not touch the MicroPython heap: when
+ * time events add steps beyond the preallocated capacity, the rows are moved
+ * to a C heap buffer, copied back by the calling thread at the end of the sweep.
+ *
+ * @return 0 on success, -1 if the buffer could not be grown
+ */
+static int sweep_run_append(SweepRun *run, size_t nColumns, const SimulationState *state) {
+    if (run->nRows == run->capacity) {
+        double *rows = (double*)malloc(2 * run->capacity * nColumns * sizeof(double));
+        if (!rows) return -1;
+        memcpy(rows, run->rows, run->nRows * nColumns * sizeof(double));
+        if (run->spilled) free(run->rows);
+        run->rows = rows;
+        run->capacity *= 2;
+        run->spilled = 1;
+    }
+    double *row = &run->rows[run->nRows * nColumns];
+    row[0] = (double)state->nSteps;
+    memcpy(&row[1], state->output, (nColumns - 1) * sizeof(double));
+    run->nRows++;
+    return 0;
+}
+
+/**
+ * @brief Simulates one run of a parameter sweep, without using the MicroPython heap.
+ *
+ * @param arena Arena of the worker, NULL if none
+ */
+static void sweep_simulate_run(SweepContext *ctx, SweepRun *run, Arena *arena) {
+    FMU *fmu = ctx->model->fmu;
+    SimulationOptions options = ctx->options;
+    options.arena = arena;
+    SimulationState *state = initializeSimulation(ctx->model, ctx->tStart, ctx->tEnd, ctx->h, &options);
+    if (!state) {
+        run->status = fmi2Error;
+        return;
+    }
+
+    // Start values are set in initialization mode, like change_variable_value()
+    for (int i = 0; i < run->nParams && run->status <= fmi2Warning; i++) {
+        const SweepParam *p = &run->params[i];
+        fmi2Status status;
+        if (p->type == REAL) {
+            fmi2Real value = p->value;
+            status = fmu->setReal(state->component, &p->vr, 1, &value);
+        } else if (p->type == INTEGER || p->type == ENUMERATION) {
+            fmi2Integer value = (fmi2Integer)p->value;
+            status = fmu->setInteger(state->component, &p->vr, 1, &value);
+        } else {
+            fmi2Boolean value = p->value != 0;
+            status = fmu->setBoolean(state->component, &p->vr, 1, &value);
+        }
+        if (status > run->status) run->status = status;
+    }
+
+    while (run->status <= fmi2Warning && !simulation_finished(state)) {
+        fmi2Status status = simulationDoStep(fmu, state);
+        if (status > fmi2Discard) {
+            run->status = status;
+        } else if (sweep_run_append(run, ctx->nColumns, state) < 0) {
+            run->status = fmi2Fatal;
+        }
+    }
+    // The arena is reset with the instance, the next run of the worker reuses its memory
+    cleanupSimulation(fmu, state);
+}
+
+/**
+ * @brief Simulates runs until the sweep has none left to hand out.
+ *
+ * With an arena size, the instances of the worker all allocate from the same
+ * arena, which no longer uses malloc() once the first run has warmed it up.
+ */
+static void sweep_work(SweepContext *ctx) {
+    Arena *arena = ctx->arenaSize > 0 ? arenaNew(ctx->arenaSize) : NULL;
+    for (;;) {
+        #if MICROPY_PY_THREAD
+        monitorLock(&ctx->monitor);
+        #endif
+        size_t i = ctx->nextRun;
+        if (i < ctx->nRuns) ctx->nextRun++;
+        #if MICROPY_PY_THREAD
+        monitorUnlock(&ctx->monitor);
+        #endif
+        if (i >= ctx->nRuns) break;
+        sweep_simulate_run(ctx, &ctx->runs[i], arena);
+    }
+    arenaDelete(arena);
+}
+
+#if MICROPY_PY_THREAD
+// Entry point of the sweep threads
+static void *sweep_worker_entry(void *arg) {
+    SweepContext *ctx = (SweepContext*)arg;
+    sweep_work(ctx);
+    monitorLock(&ctx->monitor);
+    ctx->nActive--;
+    monitorBroadcast(&ctx->monitor);
+    monitorUnlock(&ctx->monitor);
+    mp_thread_finish();
+    return NULL;
+}
+
+/**
+ * @brief Waits for the started workers of a sweep to finish, without the GIL.
+ *
+ * @param stop Hand out no more runs, the workers only finish their current one
+ */
+static void sweep_join_workers(SweepContext *ctx, int stop) {
+    monitorLock(&ctx->monitor);
+    if (stop) ctx->nextRun = ctx->nRuns;
+    while (ctx->nActive > 0) {
+        monitorWait(&ctx->monitor);
+    }
+    monitorUnlock(&ctx->monitor);
+}
+#endif
+
+/**
+ * @brief Returns the default number of threads of a parameter sweep.
+ */
+static int sweep_default_workers(void) {
+    #if MICROPY_PY_THREAD && defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+    #else
+    return 1;
+    #endif
+}
+
+/**
+ * @brief Converts a dict of start values into parameters of a sweep run.
+ *
+ * @param fmuModel Model of the variables
+ * @param row_in A dict mapping variable names or indices to start values
+ * @param nParams Set to the number of parameters
+ * @return An array of parameters allocated on the MicroPython heap
+ */
+static SweepParam *sweep_get_params(const FMUModel *fmuModel, mp_obj_t row_in, int *nParams) {
+    mp_map_t *map = mp_obj_dict_get_map(row_in);
+    SweepParam *params = m_new(SweepParam, map->used + 1);
+    const ScalarVariable *variables = fmuModel->variables;
+    *nParams = 0;
+    for (size_t i = 0; i < map->alloc; i++) {
+        if (!mp_map_slot_is_filled(map, i)) continue;
+        int idx = resolve_variable(fmuModel, map->table[i].key);
+        if (idx == 0 || variables[idx-1].type == STRING) {
+            mp_raise_ValueError(MP_ERROR_TEXT("Variable cannot be set"));
+        }
+        SweepParam *p = &params[(*nParams)++];
+        p->vr = variables[idx-1].valueReference;
+        p->type = variables[idx-1].type;
+        p->value = mp_obj_get_float(map->table[i].value);
+    }
+    return params;
+}
+
+/**
+ * @brief Runs the same simulation for every set of start values of a parameter table.
+ *
+ * Each run gets its own FMU instance and its own preallocated result buffer.
+ * The runs are spread over a pool of threads created with the port's thread
+ * primitives; they only use the C heap, so they run outside the GIL and the
+ * calling thread returns once all of them are finished.
+ *
+ * @param param_table A list of dicts mapping variable names or indices to start values.
+ * @param start_time The start time of the simulations.
+ * @param end_time The end time of the simulations.
+ * @param step_size The step size of the simulations.
+ * @param outputs Optional list of the names or indices of the variables to record,
+ *        all variables being recorded by default.
+ * @param solver Optional keyword naming the integration method: "euler" (default),
+ *        "rk4", "dopri5" or "bdf".
+ * @param tolerance Optional keyword giving the relative tolerance of "dopri5" and "bdf".
+ * @param dense Optional keyword: with "dopri5", the outputs are interpolated
+ *        at each step instead of stopping the integrator there.
+ * @param workers Optional keyword giving the number of threads, the number of
+ *        online processors by default.
+ * @return A list holding, for each run, a row-major memoryview('d') of
+ *         (step, outputs...) rows, as returned by simulate(layout="rows").
+ */
+static mp_obj_t example_sweep(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_param_table, ARG_start_time, ARG_end_time, ARG_step_size, ARG_outputs, ARG_solver, ARG_tolerance, ARG_interface, ARG_dense, ARG_model, ARG_workers, ARG_arena };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_param_table, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_start_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_end_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_step_size, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_outputs, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_solver, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_tolerance, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_interface, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_dense, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+		{ MP_QSTR_model, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_workers, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+		{ MP_QSTR_arena, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+	// Same values as the arena= of simulate, each thread allocates its own arena
+	mp_obj_t arena_in = args[ARG_arena].u_obj;
+	if (arena_in != mp_const_none && (!mp_obj_is_int(arena_in) || mp_obj_get_int(arena_in) <= 0)) {
+		mp_raise_ValueError(MP_ERROR_TEXT("arena must be a positive size"));
+	}
+
+	double tStart = mp_obj_get_float(args[ARG_start_time].u_obj);
+	double tEnd = mp_obj_get_float(args[ARG_end_time].u_obj);
+	double h = mp_obj_get_float(args[ARG_step_size].u_obj);
+	if (h <= 0 || tEnd < tStart) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Invalid simulation interval"));
+	}
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	SimulationOptions options;
+	get_simulation_options(fmuModel, &options, args[ARG_outputs].u_obj, args[ARG_solver].u_obj,
+	                       args[ARG_tolerance].u_obj, args[ARG_interface].u_obj, args[ARG_dense].u_bool);
+
+	size_t nRuns;
+	mp_obj_t *rows;
+	mp_obj_get_array(args[ARG_param_table].u_obj, &nRuns, &rows);
+
+	// Everything the workers need is allocated here, by the calling thread.
+	// The context is reachable from the thread list, so the GC keeps it alive.
+	SweepContext *ctx = m_new0(SweepContext, 1);
+	ctx->options = options;
+	ctx->arenaSize = arena_in == mp_const_none ? 0 : mp_obj_get_int(arena_in);
+	ctx->tStart = tStart;
+	ctx->tEnd = tEnd;
+	ctx->h = h;
+	ctx->nColumns = (options.outputs ? options.nOutputs : fmuModel->nVariables) + 1;
+	ctx->runs = m_new0(SweepRun, nRuns + 1);
+	ctx->nRuns = nRuns;
+	size_t capacity = (size_t)((tEnd - tStart) / h + 0.5) + 2;
+	for (size_t i = 0; i < nRuns; i++) {
+		SweepRun *run = &ctx->runs[i];
+		run->params = sweep_get_params(fmuModel, rows[i], &run->nParams);
+		run->rows = m_new(double, capacity * ctx->nColumns);
+		run->capacity = capacity;
+	}
+
+	// The model is released below, before anything else can raise
+	ctx->model = model_acquire(fmuModel);
+
+	int nWorkers = args[ARG_workers].u_int > 0 ? args[ARG_workers].u_int : sweep_default_workers();
+	if ((size_t)nWorkers > nRuns) {
+		nWorkers = nRuns > 0 ? (int)nRuns : 1;
+	}
+
+	#if MICROPY_PY_THREAD
+	monitorInit(&ctx->monitor);
+	// The calling thread is one of the workers. If a thread cannot be
+	// created, the ones already started are stopped before raising.
+	nlr_buf_t nlr;
+	if (nlr_push(&nlr) == 0) {
+		for (int i = 1; i < nWorkers; i++) {
+			size_t stack_size = 0;
+			mp_thread_create(sweep_worker_entry, ctx, &stack_size);
+			monitorLock(&ctx->monitor);
+			ctx->nActive++;
+			monitorUnlock(&ctx->monitor);
+		}
+		nlr_pop();
+	} else {
+		MP_THREAD_GIL_EXIT();
+		sweep_join_workers(ctx, 1);
+		MP_THREAD_GIL_ENTER();
+		monitorDestroy(&ctx->monitor);
+		model_release(ctx->model);
+		nlr_jump(nlr.ret_val);
+	}
+	MP_THREAD_GIL_EXIT();
+	sweep_work(ctx);
+	sweep_join_workers(ctx, 0);
+	MP_THREAD_GIL_ENTER();
+	monitorDestroy(&ctx->monitor);
+	#else
+	sweep_work(ctx);
+	#endif
+	model_release(ctx->model);
+
+	mp_obj_t result = mp_obj_new_list(nRuns, NULL);
+	fmi2Status status = fmi2OK;
+	for (size_t i = 0; i < nRuns; i++) {
+		SweepRun *run = &ctx->runs[i];
+		if (run->status > status) status = run->status;
+		double *data = run->rows;
+		if (run->spilled) {
+			data = m_new(double, run->nRows * ctx->nColumns);
+			memcpy(data, run->rows, run->nRows * ctx->nColumns * sizeof(double));
+			free(run->rows);
+		}
+		mp_obj_list_store(result, MP_OBJ_NEW_SMALL_INT(i),
+		                  mp_obj_new_memoryview('d', run->nRows * ctx->nColumns, data));
+	}
+	if (status > fmi2Warning) {
+		mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Simulation step failed: %s"),
+		                  fmi2StatusToString(status));
+	}
+	return result;
+}
+
+/**
+ * @brief Wrapper function for MicroPython to create a simulation generator.
+ *
+ * @param start_time The start time of the simulation as a MicroPython object.
+ * @param end_time The end time of the simulation as a MicroPython object.
+ * @param step_size The step size for the simulation as a MicroPython object.
+ * @param outputs Optional keyword listing the names or indices of the variables
+ *        to record, all variables being recorded by default.
+ * @param solver Optional keyword naming the integration method: "euler" (default),
+ *        "rk4", "dopri5" or "bdf".
+ * @param tolerance Optional keyword giving the relative tolerance of "dopri5" and "bdf".
+ * @param dense Optional keyword: with "dopri5", the outputs are interpolated
+ *        at each step instead of stopping the integrator there.
+ * @return A Simulation object, iterating over one (step, outputs...) tuple per
+ *         simulation step. Each object owns its own FMU instance, released by
+ *         close() or when the object is garbage collected.
+ */
+static mp_obj_t example_setup_simulation(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_start_time, ARG_end_time, ARG_step_size, ARG_outputs, ARG_solver, ARG_tolerance, ARG_interface, ARG_dense, ARG_model, ARG_arena };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_start_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_end_time, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_step_size, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_outputs, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_solver, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_tolerance, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_interface, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_dense, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false} },
+		{ MP_QSTR_model, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_arena, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	double tStart = mp_obj_get_float(args[ARG_start_time].u_obj);
+	double tEnd = mp_obj_get_float(args[ARG_end_time].u_obj);
+	double h = mp_obj_get_float(args[ARG_step_size].u_obj);
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	SimulationOptions options;
+	get_simulation_options(fmuModel, &options, args[ARG_outputs].u_obj, args[ARG_solver].u_obj,
+	                       args[ARG_tolerance].u_obj, args[ARG_interface].u_obj, args[ARG_dense].u_bool);
+
+	return MP_OBJ_FROM_PTR(simulation_new(fmuModel, tStart, tEnd, h, &options, args[ARG_arena].u_obj));
+}
+
+// On permet l'appel de ces fonctions dans python :
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_simulate_obj, 3, example_simulate);
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_setup_simulation_obj, 3, example_setup_simulation);
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_sweep_obj, 4, example_sweep);
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_simulate_to_obj, 4, example_simulate_to);
 
-    // Check for step event
-    fmi2Flag = fmu->completedIntegratorStep(state->component, fmi2True, 
-                                           &stepEvent, &terminateSimulation);
-    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+/**
+ * @brief Sets the number of reset instances kept by the pool of a model.
+ *
+ * A simulation ending gives its instance back to the pool, reset with
+ * fmi2Reset, instead of freeing it. The next simulation of the model with the
+ * same interface takes it back and skips fmi2Instantiate. The pool is empty
+ * (size 0) by default.
+ *
+ * Simulations with an arena neither take nor give back instances: a reset
+ * instance keeps its memory in the arena, which is only reset wholesale once
+ * the instance is freed, and a pooled instance could outlive its arena.
+ *
+ * @param size Number of instances kept, the extra ones are freed
+ * @param model Optional keyword, the model of the pool (default: first compiled FMU)
+ */
+static mp_obj_t example_set_pool_size(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_size, ARG_model };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_size, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+		{ MP_QSTR_model, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	mp_int_t size = args[ARG_size].u_int;
+	if (size < 0) {
+		mp_raise_ValueError(MP_ERROR_TEXT("pool size must be >= 0"));
+	}
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	if (!fmuModel->pool) {
+		fmuModel->pool = poolNew();
+	}
+	if (!fmuModel->pool || poolResize(fmuModel->pool, fmuModel->fmu, (int)size) < 0) {
+		mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the instance pool"));
+	}
+	return mp_const_none;
+}
 
-    if (terminateSimulation) {
-        state->eventInfo.terminateSimulation = fmi2True;
-        return fmi2OK;
-    }
+/**
+ * @brief Returns the statistics of the pool of a model.
+ *
+ * @param model Optional keyword, the model of the pool (default: first compiled FMU)
+ * @return A dict: size, idle (instances in the pool), hits (simulations
+ *         started from a pooled instance), misses (simulations which
+ *         instantiated the FMU while a pool was set) and discarded
+ *         (instances freed because the pool was full or fmi2Reset failed)
+ */
+static mp_obj_t example_pool_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_model };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_model, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	InstancePool *pool = fmuModel->pool;
+	size_t size = 0, idle = 0, hits = 0, misses = 0, discarded = 0;
+	if (pool) {
+		poolLock(pool);
+		size = pool->capacity;
+		idle = pool->count;
+		hits = pool->hits;
+		misses = pool->misses;
+		discarded = pool->discarded;
+		poolUnlock(pool);
+	}
 
-	INFO("Step event checked\n");
+	mp_obj_t stats = mp_obj_new_dict(5);
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_size), mp_obj_new_int_from_uint(size));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_idle), mp_obj_new_int_from_uint(idle));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_hits), mp_obj_new_int_from_uint(hits));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_misses), mp_obj_new_int_from_uint(misses));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_discarded), mp_obj_new_int_from_uint(discarded));
+	return stats;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_set_pool_size_obj, 1, example_set_pool_size);
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_pool_stats_obj, 0, example_pool_stats);
 
-    // Handle events
-    if (timeEvent || stateEvent || stepEvent) {
-        fmi2Flag = fmu->enterEventMode(state->component);
-        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+/**
+ * @brief Sets the number of states after initialization kept by the warm start cache of a model.
+ *
+ * Before its first step, a Model Exchange simulation reads the values of the
+ * variables that can be set in initialization mode. If a simulation with the
+ * same start time, stop time and values has stored its state once
+ * initialized, it is restored instead of running fmi2ExitInitializationMode
+ * and the initial event iteration. The cache is disabled (size 0) by default.
+ *
+ * @param size Number of states kept, the least recently used ones are dropped
+ * @param model Optional keyword, the model of the cache (default: first compiled FMU)
+ */
+static mp_obj_t example_set_warm_start_size(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_size, ARG_model };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_size, MP_ARG_REQUIRED | MP_ARG_INT, {.u_int = 0} },
+		{ MP_QSTR_model, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	mp_int_t size = args[ARG_size].u_int;
+	if (size < 0) {
+		mp_raise_ValueError(MP_ERROR_TEXT("warm start size must be >= 0"));
+	}
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	if (!fmuModel->warmStart) {
+		fmuModel->warmStart = warmStartNew(fmuModel->variables, fmuModel->nVariables);
+	}
+	if (!fmuModel->warmStart || warmStartResize(fmuModel->warmStart, (int)size) < 0) {
+		mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the warm start cache"));
+	}
+	return mp_const_none;
+}
 
-        if (timeEvent) state->nTimeEvents++;
-        if (stateEvent) state->nStateEvents++;
-        if (stepEvent) state->nStepEvents++;
-		INFO("Event handled\n");
+/**
+ * @brief Returns the statistics of the warm start cache of a model.
+ *
+ * @param model Optional keyword, the model of the cache (default: first compiled FMU)
+ * @return A dict: size, entries (stored states), hits (initializations
+ *         restored from a state) and misses (initializations run while the
+ *         cache was enabled)
+ */
+static mp_obj_t example_warm_start_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_model };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_model, MP_ARG_OBJ, {.u_obj = mp_const_none} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	FMUModel *fmuModel = model_from_obj(args[ARG_model].u_obj);
+	WarmStartCache *cache = fmuModel->warmStart;
+	size_t size = 0, entries = 0, hits = 0, misses = 0;
+	if (cache) {
+		warmStartLock(cache);
+		size = cache->capacity;
+		entries = cache->count;
+		hits = cache->hits;
+		misses = cache->misses;
+		warmStartUnlock(cache);
+	}
 
-        // Event iteration
-        state->eventInfo.newDiscreteStatesNeeded = fmi2True;
-        state->eventInfo.terminateSimulation = fmi2False;
-        
-        while (state->eventInfo.newDiscreteStatesNeeded && 
-               !state->eventInfo.terminateSimulation) {
-            fmi2Flag = fmu->newDiscreteStates(state->component, &state->eventInfo);
-            if (fmi2Flag > fmi2Warning) return fmi2Flag;
-        }
+	mp_obj_t stats = mp_obj_new_dict(4);
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_size), mp_obj_new_int_from_uint(size));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_entries), mp_obj_new_int_from_uint(entries));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_hits), mp_obj_new_int_from_uint(hits));
+	mp_obj_dict_store(stats, MP_OBJ_NEW_QSTR(MP_QSTR_misses), mp_obj_new_int_from_uint(misses));
+	return stats;
+}
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_set_warm_start_size_obj, 1, example_set_warm_start_size);
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_warm_start_stats_obj, 0, example_warm_start_stats);
 
-        if (state->eventInfo.terminateSimulation) {
-            return fmi2OK;
-        }
+static mp_obj_t example_get_variable_count() {
+	return mp_obj_new_int(builtin_model()->nVariables);
+}
 
-        // Re-enter continuous-time mode
-        fmi2Flag = fmu->enterContinuousTimeMode(state->component);
-        if (fmi2Flag > fmi2Warning) return fmi2Flag;
-    }
+/**
+ * @brief Sets the value of a variable of a simulation, before or between steps.
+ *
+ * change_variable_value(simInstance, variable, value)
+ *
+ * The value is checked against the type of the variable before the FMU is
+ * touched: a number for a Real, an int or an integral float within the range
+ * of fmi2Integer for an Integer or an Enumeration, a bool (or 0 and 1) for a
+ * Boolean.
+ *
+ * @param sim The Simulation
+ * @param variable The name of the variable, or its handle returned by resolve()
+ * @param value The new value
+ * @return True, raises a ValueError if the FMU refuses the value
+ */
+static mp_obj_t example_change_variable_value(size_t n_args, const mp_obj_t *args) {
+	mp_obj_t value = args[2];
+	SimulationState *state = simulation_get_state(args[0]);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+	// An index, such as a handle returned by resolve(), skips the name lookup
+	int idx = resolve_variable(self->model, args[1]);
+	const ScalarVariable *var = &state->variables[idx > 0 ? idx-1 : 0];
+	if (idx == 0 || var->type == STRING) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Variable cannot be set"));
+	}
 
-    // Update outputs
-    for (int i = 0; i < state->nVariables; i++) {
-        if (state->variables[i].type == REAL) {
-            fmu->getReal(state->component, &state->variables[i].valueReference, 
-                        1, &state->output[i]);
-			INFO("DEBUG:   %s (ref %d): %f\n", state->variables[i].name, 
-                   state->variables[i].valueReference, state->output[i]);
-        } else if (state->variables[i].type == INTEGER) {
-            fmi2Integer intValue;
-            fmu->getInteger(state->component, &state->variables[i].valueReference, 
-                           1, &intValue);
-            state->output[i] = (double)intValue;
-        }
-    }
+	fmi2Real realValue = 0;
+	fmi2Integer intValue = 0;
+	fmi2Boolean boolValue = fmi2False;
+	if (var->type == REAL) {
+		if (!mp_obj_is_int(value) && !mp_obj_is_float(value)) {
+			mp_raise_TypeError(MP_ERROR_TEXT("expecting a number"));
+		}
+		realValue = mp_obj_get_float(value);
+	} else if (var->type == BOOLEAN) {
+		if (!mp_obj_is_bool(value) && !mp_obj_is_int(value)) {
+			mp_raise_TypeError(MP_ERROR_TEXT("expecting a bool"));
+		}
+		mp_int_t b = mp_obj_get_int(value);
+		if (b != 0 && b != 1) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Boolean value must be 0 or 1"));
+		}
+		boolValue = b ? fmi2True : fmi2False;
+	} else if (mp_obj_is_float(value)) {
+		mp_float_t f = mp_obj_get_float(value);
+		if (f != MICROPY_FLOAT_C_FUN(floor)(f)) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Integer value must be integral"));
+		}
+		if (f < INT_MIN || f > INT_MAX) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Integer value out of range"));
+		}
+		intValue = (fmi2Integer)f;
+	} else if (mp_obj_is_int(value)) {
+		mp_int_t i = mp_obj_get_int(value);
+		if (i < INT_MIN || i > INT_MAX) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Integer value out of range"));
+		}
+		intValue = (fmi2Integer)i;
+	} else {
+		mp_raise_TypeError(MP_ERROR_TEXT("expecting an int"));
+	}
 
-    state->nSteps++;
-    return fmi2OK;
+	fmi2ValueReference vr = var->valueReference;
+	fmi2Status status = denseRewind(self->fmu, state);
+	if (status > fmi2Warning) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Failed to set variable value"));
+	}
+	solverForgetDerivatives(&state->solver);
+	if (var->type == REAL) {
+		status = self->fmu->setReal(state->component, &vr, 1, &realValue);
+	} else if (var->type == BOOLEAN) {
+		status = self->fmu->setBoolean(state->component, &vr, 1, &boolValue);
+	} else {
+		status = self->fmu->setInteger(state->component, &vr, 1, &intValue);
+	}
+	if (status > fmi2Warning) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Failed to set variable value"));
+	}
+	INFO("Variable %s set\n", var->name);
+	return mp_const_true;
 }
 
+/**
+ * @brief Returns the handle of a variable, to be used instead of its name in hot loops.
+ *
+ * The handle is the index of the variable in get_variables_names(). It is
+ * accepted wherever a variable name is, and skips the name lookup.
+ *
+ * @param name The name of the variable, or an index which is checked and returned.
+ * @return The handle of the variable.
+ */
+static mp_obj_t example_resolve(mp_obj_t name_in) {
+	return MP_OBJ_NEW_SMALL_INT(resolve_variable(builtin_model(), name_in));
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_resolve_obj, example_resolve);
 
-// Structure pour stocker l'état du générateur
-typedef struct example_My_Generator_obj_t {
-	mp_obj_base_t base;
-	SimulationState state;
-} example_My_Generator_obj_t;
-
-// Fonction print, gère MyGenerator.__repr__ et MyGenerator.__str__
-static void example_MyGenerator_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
-	example_My_Generator_obj_t *self = MP_OBJ_TO_PTR(self_in);
-	if (kind == PRINT_STR) {
-		mp_printf(print, "MyGenerator(%d, %d)", self->state.nSteps*self->state.h, self->state.tEnd);
-	} else {
-		mp_printf(print, "%d", self->state.nSteps);
+/**
+ * @brief Resolves the handles of a set of inputs into variable indices.
+ *
+ * @param fmuModel Model of the inputs
+ * @param handles_in A list or tuple of names and/or handles
+ * @param nInputs Set to the number of inputs
+ * @return An array of variable indices allocated on the MicroPython heap
+ */
+static int *resolve_inputs(const FMUModel *fmuModel, mp_obj_t handles_in, int *nInputs) {
+	size_t len;
+	mp_obj_t *items;
+	mp_obj_get_array(handles_in, &len, &items);
+	const ScalarVariable *variables = fmuModel->variables;
+	int *inputs = m_new(int, len + 1);
+	for (size_t i = 0; i < len; i++) {
+		int idx = resolve_variable(fmuModel, items[i]);
+		if (idx == 0 || variables[idx-1].type == STRING) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Variable cannot be set"));
+		}
+		inputs[i] = idx - 1;
 	}
+	*nInputs = (int)len;
+	return inputs;
 }
 
-static mp_obj_t get_output_tuple(SimulationState* state) {
-    mp_obj_t *items = m_new(mp_obj_t, state->nVariables+1);
-	items[0] = mp_obj_new_int(state->nSteps);
-	for (int i = 0; i < state->nVariables; i++) {
-		items[i+1] = mp_obj_new_float(state->output[i]);
+/**
+ * @brief Returns the doubles of an array('d') or memoryview('d'), without copy.
+ *
+ * @param values_in The buffer
+ * @param len Set to the number of doubles
+ * @return A pointer to the doubles, or NULL if values_in is not a buffer of doubles
+ */
+static const double *get_double_buffer(mp_obj_t values_in, size_t *len) {
+	mp_buffer_info_t bufinfo;
+	if (!mp_get_buffer(values_in, &bufinfo, MP_BUFFER_READ) || bufinfo.typecode != 'd') {
+		return NULL;
 	}
-	mp_obj_t tuple = mp_obj_new_tuple(state->nVariables, items);
-	return tuple;
+	*len = bufinfo.len / sizeof(double);
+	return (const double*)bufinfo.buf;
 }
 
-// Fonction "itérable" appelée pour obtenir le prochain élément
-static mp_obj_t my_generator_next(mp_obj_t self_in) {
-	example_My_Generator_obj_t *self = MP_OBJ_TO_PTR(self_in);
+/**
+ * @brief Sets several inputs at once, with one set call per variable type.
+ *
+ * set_inputs(simInstance, handles, values)
+ *
+ * @param sim The Simulation
+ * @param handles A list or tuple of names and/or handles returned by resolve()
+ * @param values An array('d') (read without copy) or a sequence of numbers,
+ *        one per handle
+ * @return True
+ */
+static mp_obj_t example_set_inputs(mp_obj_t sim_in, mp_obj_t handles_in, mp_obj_t values_in) {
+	SimulationState *state = simulation_get_state(sim_in);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(sim_in);
+	int nInputs;
+	int *inputs = resolve_inputs(self->model, handles_in, &nInputs);
+
+	size_t len;
+	const double *row = get_double_buffer(values_in, &len);
+	if (!row) {
+		mp_obj_t *items;
+		mp_obj_get_array(values_in, &len, &items);
+		double *values = m_new(double, len + 1);
+		for (size_t i = 0; i < len; i++) {
+			values[i] = mp_obj_get_float(items[i]);
+		}
+		row = values;
+	}
+	if (len != (size_t)nInputs) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Expecting one value per input"));
+	}
 
-	simulationDoStep(&fmu, &self->state);
+	InputMap map;
+	if (buildInputMap(state->variables, inputs, nInputs, &map) < 0) {
+		mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the inputs"));
+	}
+	fmi2Status status = applyInputs(self->fmu, state, &map, row);
+	freeInputMap(&map);
+	if (status > fmi2Warning) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Failed to set variable value"));
+	}
+	return mp_const_true;
+}
+static MP_DEFINE_CONST_FUN_OBJ_3(example_set_inputs_obj, example_set_inputs);
 
-	if (self->state.time >= self->state.tEnd || self->state.eventInfo.terminateSimulation) {
-		return mp_make_stop_iteration(MP_OBJ_NULL); // Signal de fin
+/**
+ * @brief Attaches a time-indexed input table to a simulation.
+ *
+ * Row k of the table is set, with one set call per variable type, before the
+ * step k+1 of the simulation, without going back to Python. The simulation
+ * keeps its inputs once the table is exhausted.
+ *
+ * set_input_table(simInstance, handles, table)
+ *
+ * @param sim The Simulation
+ * @param handles A list or tuple of names and/or handles returned by resolve()
+ * @param table An array('d') of rows of one value per handle, copied so that
+ *        it can be changed afterwards, or None to detach the table
+ * @return The number of rows
+ */
+static mp_obj_t example_set_input_table(mp_obj_t sim_in, mp_obj_t handles_in, mp_obj_t table_in) {
+	SimulationState *state = simulation_get_state(sim_in);
+	example_Simulation_obj_t *self = MP_OBJ_TO_PTR(sim_in);
+
+	freeInputMap(&state->inputMap);
+	free(state->inputRows);
+	state->inputRows = NULL;
+	state->nInputRows = 0;
+	if (table_in == mp_const_none) {
+		return MP_OBJ_NEW_SMALL_INT(0);
 	}
 
-	return get_output_tuple(&self->state);
-} 
+	int nInputs;
+	int *inputs = resolve_inputs(self->model, handles_in, &nInputs);
+	size_t len;
+	const double *rows = get_double_buffer(table_in, &len);
+	if (!rows) {
+		mp_raise_TypeError(MP_ERROR_TEXT("expecting an array('d')"));
+	}
+	if (nInputs == 0 || len % nInputs != 0) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Expecting one value per input in each row"));
+	}
 
+	// Copied, an append() to the array may move its memory while the simulation runs
+	double *copy = (double*)malloc((len + 1) * sizeof(double));
+	if (!copy || buildInputMap(state->variables, inputs, nInputs, &state->inputMap) < 0) {
+		free(copy);
+		mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("Failed to allocate the inputs"));
+	}
+	memcpy(copy, rows, len * sizeof(double));
+	state->inputRows = copy;
+	state->nInputRows = len / nInputs;
+	return mp_obj_new_int_from_uint(state->nInputRows);
+}
+static MP_DEFINE_CONST_FUN_OBJ_3(example_set_input_table_obj, example_set_input_table);
 
-// Définition du type
-MP_DEFINE_CONST_OBJ_TYPE(
-	example_type_MyGenerator,
-	MP_QSTR_MyGenerator,
-	MP_TYPE_FLAG_ITER_IS_ITERNEXT,
-	print, example_MyGenerator_print,
-	//make_new, my_generator_make_new,
-	iter, my_generator_next//,
-	//locals_dict,&example_MyGenerator_locals_dict
-	);
+// Objet Coupling : simulations avancées ensemble par l'algorithme maître
+typedef struct example_Coupling_obj_t {
+	mp_obj_base_t base;
+	Master *master;
+	mp_obj_t *simulations;   // Simulation objects of the instances, kept alive for the GC
+	int nWorkers;            // threads stepping the instances of a Jacobi step in run()
+} example_Coupling_obj_t;
 
+extern const mp_obj_type_t example_type_Coupling;
 
 /**
- * @brief Wrapper function for MicroPython to simulate the FMU model.
- *
- * This function serves as a MicroPython interface to the `simulate` function,
- * allowing users to run simulations from within a MicroPython environment.
- *
- * @param end_time The end time of the simulation as a MicroPython object.
- * @param step_size The step size for the simulation as a MicroPython object.
- * @return A MicroPython integer object indicating the success of the simulation (always returns 1) because it crash in case of failure.
- *
- * The function performs the following steps:
- * 1. Converts the MicroPython objects `end_time` and `step_size` to double values.
- * 2. Initializes logging and category settings.
- * 3. Loads the FMU functions.
- * 4. Calls the `simulate` function with the provided parameters.
- * 5. Returns a MicroPython integer object indicating success.
+ * @brief Returns the master algorithm of an open Coupling whose simulations are all open.
  */
-static mp_obj_t example_simulate(size_t n_args, const mp_obj_t *args) {
-	double tStart = mp_obj_get_float(args[0]);
-	double tEnd = mp_obj_get_float(args[1]);
-	double h = mp_obj_get_float(args[2]);
+static Master *coupling_get_master(example_Coupling_obj_t *self) {
+	if (!self->master) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Coupling is closed"));
+	}
+	for (int i = 0; i < self->master->nInstances; i++) {
+		example_Simulation_obj_t *sim = MP_OBJ_TO_PTR(self->simulations[i]);
+		if (sim->state != self->master->instances[i].state) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Simulation is closed"));
+		}
+		simulation_check_idle(sim);
+	}
+	return self->master;
+}
 
-	loadFunctions(&fmu);
-	//simulate(&fmu, tStart, tEnd, h);
+/**
+ * @brief Marks the simulations of a Coupling as stepped by its threads, or releases them.
+ *
+ * While they are busy, closing or stepping them from Python raises a RuntimeError.
+ */
+static void coupling_set_busy(example_Coupling_obj_t *self, int busy) {
+	for (int i = 0; i < self->master->nInstances; i++) {
+		example_Simulation_obj_t *sim = MP_OBJ_TO_PTR(self->simulations[i]);
+		sim->busy = busy;
+	}
+}
 
-	SimulationState *state = initializeSimulation(&fmu, tStart, tEnd, h);
-    mp_obj_t result = mp_obj_new_list(0, NULL);
+/**
+ * @brief Raises a RuntimeError if a step of the master algorithm failed.
+ */
+static void coupling_check_status(fmi2Status status) {
+	if (status > fmi2Discard) {
+		mp_raise_msg_varg(&mp_type_RuntimeError, MP_ERROR_TEXT("Simulation step failed: %s"),
+		                  fmi2StatusToString(status));
+	}
+}
 
-    while (!(state->time >= state->tEnd || state->eventInfo.terminateSimulation)) {
-        simulationDoStep(&fmu, state);
-        mp_obj_list_append(result, get_output_tuple(state));
-    }
+/**
+ * @brief Resolves the instance of a connection end into an index of the simulations.
+ *
+ * @param sim_in An index in the simulations, or one of the Simulation objects
+ */
+static int coupling_instance(mp_obj_t sim_in, const mp_obj_t *simulations, int nSimulations) {
+	if (mp_obj_is_int(sim_in)) {
+		int i = mp_obj_get_int(sim_in);
+		if (i < 0 || i >= nSimulations) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Index out of range"));
+		}
+		return i;
+	}
+	for (int i = 0; i < nSimulations; i++) {
+		if (simulations[i] == sim_in) return i;
+	}
+	mp_raise_ValueError(MP_ERROR_TEXT("Simulation is not coupled"));
+}
 
-	return result;
+// Coupling.__del__ : libère l'algorithme maître, les simulations restent ouvertes
+static mp_obj_t example_Coupling_del(mp_obj_t self_in) {
+	example_Coupling_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (self->master) {
+		masterFree(self->master);
+		self->master = NULL;
+		self->simulations = NULL;
+	}
+	return mp_const_none;
 }
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Coupling_del_obj, example_Coupling_del);
 
-static mp_obj_t example_setup_simulation(size_t n_args, const mp_obj_t *args) {
-	double tStart = mp_obj_get_float(args[0]);
-	double tEnd = mp_obj_get_float(args[1]);
-	double h = mp_obj_get_float(args[2]);
+// Fonction print, gère Coupling.__repr__ et Coupling.__str__
+static void example_Coupling_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+	example_Coupling_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (!self->master) {
+		mp_printf(print, "Coupling(closed)");
+	} else {
+		mp_printf(print, "Coupling(%d simulations, %s)", self->master->nInstances,
+		          self->master->jacobi ? "jacobi" : "gauss_seidel");
+	}
+}
 
-	loadFunctions(&fmu);
-	SimulationState *state;
-	state = initializeSimulation(&fmu, tStart, tEnd, h);
+// Fonction "itérable" : un pas de communication, renvoie un tuple de sorties par simulation
+static mp_obj_t coupling_next(mp_obj_t self_in) {
+	example_Coupling_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (!self->master) {
+		return mp_make_stop_iteration(MP_OBJ_NULL);
+	}
+	Master *master = coupling_get_master(self);
+	fmi2Status status = masterDoStep(master, 0);
+	coupling_check_status(status);
+	if (masterFinished(master)) {
+		return mp_make_stop_iteration(MP_OBJ_NULL); // Signal de fin
+	}
 
-	example_My_Generator_obj_t *self;
-	self = mp_obj_malloc(example_My_Generator_obj_t, &example_type_MyGenerator);
-	self->base.type = &example_type_MyGenerator;
-	self->state = *state;
-	return MP_OBJ_FROM_PTR(self);
+	mp_obj_tuple_t *result = MP_OBJ_TO_PTR(mp_obj_new_tuple(master->nInstances, NULL));
+	for (int i = 0; i < master->nInstances; i++) {
+		result->items[i] = get_output_tuple(master->instances[i].state);
+	}
+	return MP_OBJ_FROM_PTR(result);
 }
 
-// On permet l'appel de ces fonctions dans python :
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_simulate_obj, 3, 3, example_simulate);
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_setup_simulation_obj, 3, 3, example_setup_simulation);
-
-static int get_variable_index(const char * name) {
-	ScalarVariable *variables;
-	int nVariables = get_variable_count();
-	get_variable_list(&variables);
-    if (strcmp(name, "step") == 0) {
-		return 0;
-	}
-	for (int i = 0; i < nVariables; i++) {
-		if (strcmp(variables[i].name, name) == 0) {
-			return i+1;
+/**
+ * @brief Steps the coupled simulations without going back to Python.
+ *
+ * Coupling.run(steps=-1)
+ *
+ * The Jacobi steps are shared between the threads of the coupling, started for
+ * the duration of the call. The simulations are busy until it returns: they
+ * cannot be closed or stepped from another thread meanwhile.
+ *
+ * @param steps Maximum number of communication steps, -1 to run until one of
+ *        the simulations reaches its end time
+ * @return The number of communication steps performed
+ */
+static mp_obj_t example_Coupling_run(size_t n_args, const mp_obj_t *args) {
+	example_Coupling_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+	Master *master = coupling_get_master(self);
+	mp_int_t steps = n_args > 1 ? mp_obj_get_int(args[1]) : -1;
+
+	int nSteps = master->nSteps;
+	fmi2Status status = fmi2OK;
+	coupling_set_busy(self, 1);
+	#if MICROPY_PY_THREAD
+	int threaded = master->jacobi && self->nWorkers > 1;
+	if (threaded) {
+		nlr_buf_t nlr;
+		if (nlr_push(&nlr) == 0) {
+			masterStartWorkers(master, self->nWorkers);
+			nlr_pop();
+		} else {
+			coupling_set_busy(self, 0);
+			nlr_jump(nlr.ret_val);
 		}
 	}
-	return -1;
+	MP_THREAD_GIL_EXIT();
+	#else
+	int threaded = 0;
+	#endif
+	for (mp_int_t k = 0; steps < 0 || k < steps; k++) {
+		status = masterDoStep(master, threaded);
+		if (status > fmi2Warning) break;
+	}
+	#if MICROPY_PY_THREAD
+	if (threaded) masterStopWorkers(master);
+	MP_THREAD_GIL_ENTER();
+	#endif
+	coupling_set_busy(self, 0);
+	coupling_check_status(status);
+	return mp_obj_new_int(master->nSteps - nSteps);
 }
-
-static mp_obj_t example_get_variable_count() {
-	return mp_obj_new_int(NVARIABLES);
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_Coupling_run_obj, 1, 2, example_Coupling_run);
+
+// Coupling.order() : ordre Gauss-Seidel des simulations, calculé depuis les connexions
+static mp_obj_t example_Coupling_order(mp_obj_t self_in) {
+	example_Coupling_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	Master *master = coupling_get_master(self);
+	mp_obj_t order = mp_obj_new_list(master->nInstances, NULL);
+	for (int k = 0; k < master->nInstances; k++) {
+		mp_obj_list_store(order, MP_OBJ_NEW_SMALL_INT(k), MP_OBJ_NEW_SMALL_INT(master->order[k]));
+	}
+	return order;
 }
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Coupling_order_obj, example_Coupling_order);
 
-static mp_obj_t example_change_variable_value(size_t n_args, const mp_obj_t *args) { //TODO: more robust arg check
-	//mp_obj_t generator, mp_obj_t ValueReference, mp_obj_t value
-	//fmi2Status status;
-	mp_obj_t generator = args[0];
-	mp_obj_t ValueReference = args[1];
-	mp_obj_t value = args[2];
+static const mp_rom_map_elem_t example_Coupling_locals_dict_table[] = {
+	{ MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&example_Coupling_del_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&example_Coupling_del_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&example_Coupling_run_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_order), MP_ROM_PTR(&example_Coupling_order_obj) },
+};
+static MP_DEFINE_CONST_DICT(example_Coupling_locals_dict, example_Coupling_locals_dict_table);
 
-	if (mp_obj_is_str(ValueReference)) {
-		const char *name = mp_obj_str_get_str(ValueReference);
-		int idx = get_variable_index(name);
-		if (idx > 0) {
-			ValueReference = mp_obj_new_int(idx);
-		} else {
-			mp_raise_ValueError(MP_ERROR_TEXT("Variable not found"));
-			return mp_const_false;
+// Définition du type
+MP_DEFINE_CONST_OBJ_TYPE(
+	example_type_Coupling,
+	MP_QSTR_Coupling,
+	MP_TYPE_FLAG_ITER_IS_ITERNEXT,
+	print, example_Coupling_print,
+	iter, coupling_next,
+	locals_dict, &example_Coupling_locals_dict
+	);
+
+/**
+ * @brief Couples several simulations with a master algorithm.
+ *
+ * couple(simulations, connections, method="gauss_seidel", workers=0)
+ *
+ * At each communication step, every connection copies an output of a simulation
+ * to an input of another, then all the simulations advance by one step.
+ *
+ * @param simulations A list of distinct initialized Simulation objects, at the
+ *        same time and with the same step size
+ * @param connections A list of (source, output, destination, input) tuples,
+ *        source and destination being indices in simulations or Simulation
+ *        objects, output and input variable names or indices of their model.
+ *        An input is connected at most once.
+ * @param method "gauss_seidel" (default): the simulations are stepped one after
+ *        the other, in the order of the connection graph, with the outputs their
+ *        sources have just computed; "jacobi": all of them are stepped with the
+ *        outputs of the previous communication point.
+ * @param workers Number of threads of the Jacobi steps of run(), one per core by default
+ * @return A Coupling object, iterating over one tuple of (step, outputs...)
+ *         tuples per communication step
+ */
+static mp_obj_t example_couple(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+	enum { ARG_simulations, ARG_connections, ARG_method, ARG_workers };
+	static const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_simulations, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_connections, MP_ARG_REQUIRED | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+		{ MP_QSTR_method, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = mp_const_none} },
+		{ MP_QSTR_workers, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	int jacobi = 0;
+	if (args[ARG_method].u_obj != mp_const_none) {
+		const char *method = mp_obj_str_get_str(args[ARG_method].u_obj);
+		if (strcmp(method, "jacobi") == 0) {
+			jacobi = 1;
+		} else if (strcmp(method, "gauss_seidel") != 0) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Unknown method"));
 		}
 	}
 
-	//ModelInstance* instance = (ModelInstance*)self->state.component;
-	//printf("ValueReference: %ld\n", mp_obj_get_int(ValueReference));
-	example_My_Generator_obj_t *self = MP_OBJ_TO_PTR(generator);
-	const double val = mp_obj_get_float(value);
-	size_t index = 0;
-	fmi2Status status = setFloat64(self->state.component, mp_obj_get_int(ValueReference)-1, &val, 1, &index);
-	if (status > fmi2Warning) {
-		mp_raise_ValueError(MP_ERROR_TEXT("Failed to set variable value"));
-		return mp_const_false;
+	size_t nSimulations;
+	mp_obj_t *items;
+	mp_obj_get_array(args[ARG_simulations].u_obj, &nSimulations, &items);
+	if (nSimulations == 0) {
+		mp_raise_ValueError(MP_ERROR_TEXT("Expecting at least one simulation"));
+	}
+	mp_obj_t *simulations = m_new(mp_obj_t, nSimulations);
+	FMU **fmus = m_new(FMU *, nSimulations);
+	SimulationState **states = m_new(SimulationState *, nSimulations);
+	for (size_t i = 0; i < nSimulations; i++) {
+		states[i] = simulation_get_state(items[i]);
+		for (size_t k = 0; k < i; k++) {
+			if (items[k] == items[i]) {
+				mp_raise_ValueError(MP_ERROR_TEXT("Simulation coupled twice"));
+			}
+		}
+		simulations[i] = items[i];
+		fmus[i] = ((example_Simulation_obj_t *)MP_OBJ_TO_PTR(items[i]))->fmu;
+		if (states[i]->time != states[0]->time || states[i]->h != states[0]->h) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Simulations must share their time and step size"));
+		}
+	}
+
+	size_t nConnections;
+	mp_obj_get_array(args[ARG_connections].u_obj, &nConnections, &items);
+	Connection *connections = m_new(Connection, nConnections + 1);
+	for (size_t c = 0; c < nConnections; c++) {
+		size_t len;
+		mp_obj_t *ends;
+		mp_obj_get_array(items[c], &len, &ends);
+		if (len != 4) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Expecting (source, output, destination, input) connections"));
+		}
+		Connection *conn = &connections[c];
+		conn->from = coupling_instance(ends[0], simulations, nSimulations);
+		conn->to = coupling_instance(ends[2], simulations, nSimulations);
+		const FMUModel *fromModel = ((example_Simulation_obj_t *)MP_OBJ_TO_PTR(simulations[conn->from]))->model;
+		const FMUModel *toModel = ((example_Simulation_obj_t *)MP_OBJ_TO_PTR(simulations[conn->to]))->model;
+		conn->output = resolve_variable(fromModel, ends[1]) - 1;
+		conn->input = resolve_variable(toModel, ends[3]) - 1;
+		if (conn->output < 0 || fromModel->variables[conn->output].type == STRING ||
+		    conn->input < 0 || toModel->variables[conn->input].type == STRING) {
+			mp_raise_ValueError(MP_ERROR_TEXT("Variable cannot be connected"));
+		}
+		for (size_t k = 0; k < c; k++) {
+			if (connections[k].to == conn->to && connections[k].input == conn->input) {
+				mp_raise_ValueError(MP_ERROR_TEXT("Input connected twice"));
+			}
+		}
 	}
-    INFO("Variable %s set to %f\n", index == 0 ? "step" : self->state.variables[mp_obj_get_int(ValueReference)-1].name, val);
-	return mp_const_true;
 
+	example_Coupling_obj_t *self = mp_obj_malloc_with_finaliser(example_Coupling_obj_t, &example_type_Coupling);
+	self->simulations = simulations;
+	self->nWorkers = args[ARG_workers].u_int > 0 ? args[ARG_workers].u_int : sweep_default_workers();
+	if (self->nWorkers > (int)nSimulations) {
+		self->nWorkers = (int)nSimulations;
+	}
+	self->master = masterNew(fmus, states, (int)nSimulations, connections, (int)nConnections, jacobi);
+	if (!self->master) {
+		mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("Failed to initialize the coupling"));
+	}
+	return MP_OBJ_FROM_PTR(self);
 }
+static MP_DEFINE_CONST_FUN_OBJ_KW(example_couple_obj, 2, example_couple);
 
 // Common helper to process variables based on a custom function
-static mp_obj_t process_variables(size_t n_args, const mp_obj_t *args, mp_obj_t (*extractor)(ScalarVariable*)) {
-    ScalarVariable *variables;
-    int nVariables = get_variable_count();
+static mp_obj_t process_variables(const FMUModel *fmuModel, size_t n_args, const mp_obj_t *args,
+                                  mp_obj_t (*extractor)(const ScalarVariable*)) {
+    const ScalarVariable *variables = fmuModel->variables;
+    int nVariables = fmuModel->nVariables;
     ScalarVariable step = {
         .name = "step",
         .description = "Simulation step count",
         .type = INTEGER,
         .start = { .intValue = 0 }
     };
-    get_variable_list(&variables);
-
-    // Validate argument count
-    if ((int)n_args > (nVariables+1)) {
-        mp_raise_ValueError(MP_ERROR_TEXT("Too many arguments"));
-    }
 
     // Handle no arguments: process all variables
     if (n_args == 0) {
@@ -600,7 +3681,7 @@ static mp_obj_t process_variables(size_t n_args, const mp_obj_t *args, mp_obj_t
         for (int i = 0; i < nVariables; i++) {
             items[i+1] = extractor(&variables[i]);
         }
-        return mp_obj_new_tuple(nVariables, items);
+        return mp_obj_new_tuple(nVariables+1, items);
     }
 
     // Handle multiple arguments
@@ -617,7 +3698,7 @@ static mp_obj_t process_variables(size_t n_args, const mp_obj_t *args, mp_obj_t
             }
 		} else if (mp_obj_is_str(args[i])) {
 			const char *name = mp_obj_str_get_str(args[i]);
-			int idx = get_variable_index(name);
+			int idx = get_variable_index(fmuModel, name);
             if (idx == 0) {
                 items[i] = extractor(&step);
             } else if (idx > 0) {
@@ -633,52 +3714,196 @@ static mp_obj_t process_variables(size_t n_args, const mp_obj_t *args, mp_obj_t
 }
 
 // Extractor functions
-static mp_obj_t extract_name(ScalarVariable *var) {
+static mp_obj_t extract_name(const ScalarVariable *var) {
     return mp_obj_new_str(var->name, strlen(var->name));
 }
 
-static mp_obj_t extract_base_value(ScalarVariable *var) {
+static mp_obj_t extract_base_value(const ScalarVariable *var) {
     if (var->type == REAL) {
         return mp_obj_new_float(var->start.realValue);
-    } else if (var->type == INTEGER) {
+    } else if (var->type == INTEGER || var->type == ENUMERATION) {
         return mp_obj_new_int(var->start.intValue);
+    } else if (var->type == BOOLEAN) {
+        return mp_obj_new_bool(var->start.boolValue);
+    } else if (var->type == STRING && var->start.stringValue) {
+        return mp_obj_new_str(var->start.stringValue, strlen(var->start.stringValue));
     }
     return mp_const_none;  // Default case if type is unsupported
 }
 
-static mp_obj_t extract_description(ScalarVariable *var) {
+static mp_obj_t extract_description(const ScalarVariable *var) {
+    if (!var->description) return mp_const_none;
     return mp_obj_new_str(var->description, strlen(var->description));
 }
 
 static mp_obj_t example_get_variable_names(size_t n_args, const mp_obj_t *args) {
-    return process_variables(n_args, args, extract_name);
+    return process_variables(builtin_model(), n_args, args, extract_name);
 }
 
 static mp_obj_t example_get_variables_base_values(size_t n_args, const mp_obj_t *args) {
-    return process_variables(n_args, args, extract_base_value);
+    return process_variables(builtin_model(), n_args, args, extract_base_value);
 }
 
 static mp_obj_t example_get_variables_description(size_t n_args, const mp_obj_t *args) {
-    return process_variables(n_args, args, extract_description);
+    return process_variables(builtin_model(), n_args, args, extract_description);
 }
 
 static MP_DEFINE_CONST_FUN_OBJ_0(example_get_variable_count_obj, example_get_variable_count);
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_change_variable_value_obj, 3, 3, example_change_variable_value);
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_get_variable_names_obj, 0, NVARIABLES, example_get_variable_names);
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_get_variables_base_values_obj, 0, NVARIABLES, example_get_variables_base_values);
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(example_get_variables_description_obj, 0, NVARIABLES, example_get_variables_description);
+static MP_DEFINE_CONST_FUN_OBJ_VAR(example_get_variable_names_obj, 0, example_get_variable_names);
+static MP_DEFINE_CONST_FUN_OBJ_VAR(example_get_variables_base_values_obj, 0, example_get_variables_base_values);
+static MP_DEFINE_CONST_FUN_OBJ_VAR(example_get_variables_description_obj, 0, example_get_variables_description);
+
+// Model.__del__ : libère la FMU quand plus aucune simulation ne l'utilise
+static mp_obj_t example_Model_del(mp_obj_t self_in) {
+	example_Model_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (self->model) {
+		model_release(self->model);
+		self->model = NULL;
+	}
+	return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Model_del_obj, example_Model_del);
+
+// Fonction print, gère Model.__repr__ et Model.__str__
+static void example_Model_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind) {
+	(void)kind;
+	example_Model_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (!self->model) {
+		mp_printf(print, "Model(closed)");
+	} else {
+		mp_printf(print, "Model(%s)", self->model->description->modelName);
+	}
+}
+
+// Model.get_variables_names(), get_variables_base_values() et get_variables_description() :
+// comme les fonctions du module, pour les variables de la FMU chargée
+static mp_obj_t example_Model_get_variables_names(size_t n_args, const mp_obj_t *args) {
+    return process_variables(model_from_obj(args[0]), n_args - 1, args + 1, extract_name);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR(example_Model_get_variables_names_obj, 1, example_Model_get_variables_names);
+
+static mp_obj_t example_Model_get_variables_base_values(size_t n_args, const mp_obj_t *args) {
+    return process_variables(model_from_obj(args[0]), n_args - 1, args + 1, extract_base_value);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR(example_Model_get_variables_base_values_obj, 1, example_Model_get_variables_base_values);
+
+static mp_obj_t example_Model_get_variables_description(size_t n_args, const mp_obj_t *args) {
+    return process_variables(model_from_obj(args[0]), n_args - 1, args + 1, extract_description);
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR(example_Model_get_variables_description_obj, 1, example_Model_get_variables_description);
+
+static mp_obj_t example_Model_get_variable_count(mp_obj_t self_in) {
+	return mp_obj_new_int(model_from_obj(self_in)->nVariables);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_Model_get_variable_count_obj, example_Model_get_variable_count);
+
+static mp_obj_t example_Model_resolve(mp_obj_t self_in, mp_obj_t name_in) {
+	return MP_OBJ_NEW_SMALL_INT(resolve_variable(model_from_obj(self_in), name_in));
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(example_Model_resolve_obj, example_Model_resolve);
+
+static const mp_rom_map_elem_t example_Model_locals_dict_table[] = {
+	{ MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&example_Model_del_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&example_Model_del_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_get_variables_names), MP_ROM_PTR(&example_Model_get_variables_names_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_get_variables_base_values), MP_ROM_PTR(&example_Model_get_variables_base_values_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_get_variables_description), MP_ROM_PTR(&example_Model_get_variables_description_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_get_variable_count), MP_ROM_PTR(&example_Model_get_variable_count_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_resolve), MP_ROM_PTR(&example_Model_resolve_obj) },
+};
+static MP_DEFINE_CONST_DICT(example_Model_locals_dict, example_Model_locals_dict_table);
+
+MP_DEFINE_CONST_OBJ_TYPE(
+	example_type_Model,
+	MP_QSTR_Model,
+	MP_TYPE_FLAG_NONE,
+	print, example_Model_print,
+	locals_dict, &example_Model_locals_dict
+	);
+
+/**
+ * @brief Returns a Model for an FMU compiled into the firmware.
+ *
+ * @param name_in modelIdentifier of the FMU, as listed by get_models()
+ * @return A Model, to be passed as the model keyword of setup_simulation(),
+ *         simulate(), simulate_to() and sweep().
+ */
+static mp_obj_t example_get_model(mp_obj_t name_in) {
+	FMUModel *fmuModel = model_from_obj(name_in);
+	example_Model_obj_t *self = mp_obj_malloc_with_finaliser(example_Model_obj_t, &example_type_Model);
+	self->model = model_acquire(fmuModel);
+	return MP_OBJ_FROM_PTR(self);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_get_model_obj, example_get_model);
+
+// get_models() : modelIdentifier des FMU compilées, le modèle par défaut en premier
+static mp_obj_t example_get_models(void) {
+	mp_obj_t names = mp_obj_new_list(0, NULL);
+	for (int i = 0; i < NMODELS; i++) {
+		const char *id = compiledModels[i].modelIdentifier;
+		mp_obj_list_append(names, mp_obj_new_str(id, strlen(id)));
+	}
+	return names;
+}
+static MP_DEFINE_CONST_FUN_OBJ_0(example_get_models_obj, example_get_models);
+
+#if FMU_DLOPEN
+/**
+ * @brief Loads an FMU at run time, without rebuilding the firmware.
+ *
+ * The .fmu archive is extracted into a temporary directory, its
+ * modelDescription.xml is parsed and its shared library is opened with dlopen.
+ * The FMU is unloaded once the Model and all its simulations are closed.
+ *
+ * @param path Path of a .fmu archive, or of the directory it was extracted to.
+ * @return A Model, to be passed as the model keyword of setup_simulation(),
+ *         simulate(), simulate_to() and sweep().
+ */
+static mp_obj_t example_load_fmu(mp_obj_t path_in) {
+	const char *path = mp_obj_str_get_str(path_in);
+	example_Model_obj_t *self = mp_obj_malloc_with_finaliser(example_Model_obj_t, &example_type_Model);
+	self->model = NULL;
+	const char *error = NULL;
+	LoadedFMU *loaded = loadFMUModel(path, &error);
+	if (!loaded) {
+		mp_raise_msg_varg(&mp_type_OSError, MP_ERROR_TEXT("load_fmu: %s"), error);
+	}
+	self->model = &loaded->model;
+	return MP_OBJ_FROM_PTR(self);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(example_load_fmu_obj, example_load_fmu);
+#endif
 
 // On va mapper les noms des variables et des class :
 static const mp_rom_map_elem_t example_module_globals_table[] = {
 	{ MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_testlibrary)},
 	{ MP_ROM_QSTR(MP_QSTR_simulate), MP_ROM_PTR(&example_simulate_obj)},
 	{ MP_ROM_QSTR(MP_QSTR_setup_simulation), MP_ROM_PTR(&example_setup_simulation_obj)},
-	{ MP_ROM_QSTR(MP_QSTR_MyGenerator), MP_ROM_PTR(&example_type_MyGenerator) },
+	{ MP_ROM_QSTR(MP_QSTR_sweep), MP_ROM_PTR(&example_sweep_obj)},
+	{ MP_ROM_QSTR(MP_QSTR_couple), MP_ROM_PTR(&example_couple_obj)},
+	{ MP_ROM_QSTR(MP_QSTR_simulate_to), MP_ROM_PTR(&example_simulate_to_obj)},
+	{ MP_ROM_QSTR(MP_QSTR_set_pool_size), MP_ROM_PTR(&example_set_pool_size_obj)},
+	{ MP_ROM_QSTR(MP_QSTR_pool_stats), MP_ROM_PTR(&example_pool_stats_obj)},
+	{ MP_ROM_QSTR(MP_QSTR_set_warm_start_size), MP_ROM_PTR(&example_set_warm_start_size_obj)},
+	{ MP_ROM_QSTR(MP_QSTR_warm_start_stats), MP_ROM_PTR(&example_warm_start_stats_obj)},
+	{ MP_ROM_QSTR(MP_QSTR_Simulation), MP_ROM_PTR(&example_type_Simulation) },
+	{ MP_ROM_QSTR(MP_QSTR_MyGenerator), MP_ROM_PTR(&example_type_Simulation) },
+	{ MP_ROM_QSTR(MP_QSTR_Model), MP_ROM_PTR(&example_type_Model) },
+	{ MP_ROM_QSTR(MP_QSTR_Coupling), MP_ROM_PTR(&example_type_Coupling) },
+	{ MP_ROM_QSTR(MP_QSTR_get_model), MP_ROM_PTR(&example_get_model_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_get_models), MP_ROM_PTR(&example_get_models_obj) },
+	#if FMU_DLOPEN
+	{ MP_ROM_QSTR(MP_QSTR_load_fmu), MP_ROM_PTR(&example_load_fmu_obj) },
+	#endif
 	{ MP_ROM_QSTR(MP_QSTR_get_variables_names), MP_ROM_PTR(&example_get_variable_names_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_get_variables_base_values), MP_ROM_PTR(&example_get_variables_base_values_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_get_variables_description), MP_ROM_PTR(&example_get_variables_description_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_get_variable_count), MP_ROM_PTR(&example_get_variable_count_obj) },
 	{ MP_ROM_QSTR(MP_QSTR_change_variable_value), MP_ROM_PTR(&example_change_variable_value_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_resolve), MP_ROM_PTR(&example_resolve_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_set_inputs), MP_ROM_PTR(&example_set_inputs_obj) },
+	{ MP_ROM_QSTR(MP_QSTR_set_input_table), MP_ROM_PTR(&example_set_input_table_obj) },
 };
 static MP_DEFINE_CONST_DICT(example_module_globals, example_module_globals_table);
 
@@ -0,0 +1,403 @@
+/**
+ * @file master.c
+ * @brief Master algorithm advancing several coupled simulations in lock-step.
+ *
+ * Each connection copies an output of one instance to an input of another at
+ * every communication step. The values are exchanged through preallocated rows
+ * of doubles, read and written with one batched get and set call per type and
+ * per instance, so a step allocates nothing.
+ *
+ * Two orderings are available:
+ * - Jacobi: every instance receives the outputs of the previous communication
+ *   point and all of them are stepped independently, on a pool of threads;
+ * - Gauss-Seidel: the instances are stepped one after the other, in an order
+ *   computed from the connection graph, each one receiving the outputs its
+ *   sources have just computed. Instances of a cycle take the outputs of the
+ *   previous communication point of the sources that come later.
+ *
+ * Included by main.c, after the simulation loop.
+ */
+
+// Connection from an output of one instance to an input of another
+typedef struct {
+    int from;                        // index of the source instance
+    int output;                      // column of the value in the outputs row of the source
+    int to;                          // index of the destination instance
+    int input;                       // column of the value in the inputs row of the destination
+} Connection;
+
+// Instance of a coupled simulation and its exchange buffers
+typedef struct {
+    FMU *fmu;                        // function table of the model
+    SimulationState *state;          // simulation, owned by its Simulation object
+    InputMap outputs;                // variables read by the outgoing connections
+    double *outputValues;            // one value per column of outputs
+    InputMap inputs;                 // variables written by the incoming connections
+    double *inputValues;             // one value per column of inputs
+    const Connection *incoming;      // incoming connections, contiguous in Master.connections
+    int nIncoming;                   // number of incoming connections
+    fmi2Status status;               // status of the last step
+} MasterInstance;
+
+// Structure to hold a master algorithm and its thread pool
+typedef struct {
+    MasterInstance *instances;
+    int nInstances;
+    Connection *connections;         // sorted by destination
+    int nConnections;
+    int *order;                      // Gauss-Seidel order of the instances
+    int jacobi;                      // step all the instances from the previous communication point
+    int nSteps;                      // number of communication steps
+    int nextTask;                    // next instance to step, protected by monitor
+    #if MICROPY_PY_THREAD
+    Monitor monitor;                 // the workers sleep on it between two Jacobi steps
+    int generation;                  // incremented for each Jacobi step, protected by monitor
+    int pending;                     // instances not stepped yet, protected by monitor
+    int stop;                        // the workers must return, protected by monitor
+    int nActive;                     // number of running workers, protected by monitor
+    #endif
+} Master;
+
+/**
+ * @brief Frees a master algorithm, the simulations are not touched.
+ */
+static void masterFree(Master *master) {
+    if (!master) return;
+    if (master->instances) {
+        for (int i = 0; i < master->nInstances; i++) {
+            MasterInstance *inst = &master->instances[i];
+            freeInputMap(&inst->outputs);
+            freeInputMap(&inst->inputs);
+            free(inst->outputValues);
+            free(inst->inputValues);
+        }
+        free(master->instances);
+    }
+    free(master->connections);
+    free(master->order);
+    #if MICROPY_PY_THREAD
+    monitorDestroy(&master->monitor);
+    #endif
+    free(master);
+}
+
+static int compareConnections(const void *a, const void *b) {
+    const Connection *ca = (const Connection *)a;
+    const Connection *cb = (const Connection *)b;
+    if (ca->to != cb->to) return ca->to - cb->to;
+    return ca->input - cb->input;
+}
+
+/**
+ * @brief Computes the Gauss-Seidel order of the instances from the connection graph.
+ *
+ * Instances are taken in topological order (Kahn's algorithm): an instance
+ * comes after all its sources. When the remaining instances all wait for one
+ * another, the cycle is broken at the one with the lowest index.
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int masterOrder(Master *master) {
+    int n = master->nInstances;
+    int *waiting = (int*)calloc(n + 1, sizeof(int));  // sources not ordered yet
+    char *done = (char*)calloc(n + 1, 1);
+    if (!waiting || !done) {
+        free(waiting);
+        free(done);
+        return -1;
+    }
+    for (int c = 0; c < master->nConnections; c++) {
+        const Connection *conn = &master->connections[c];
+        if (conn->from != conn->to) waiting[conn->to]++;
+    }
+
+    for (int k = 0; k < n; k++) {
+        int next = -1;
+        for (int i = 0; i < n && next < 0; i++) {
+            if (!done[i] && waiting[i] == 0) next = i;
+        }
+        for (int i = 0; i < n && next < 0; i++) {
+            if (!done[i]) next = i;
+        }
+        master->order[k] = next;
+        done[next] = 1;
+        for (int c = 0; c < master->nConnections; c++) {
+            const Connection *conn = &master->connections[c];
+            if (conn->from == next && conn->to != next) waiting[conn->to]--;
+        }
+    }
+    free(waiting);
+    free(done);
+    return 0;
+}
+
+/**
+ * @brief Creates a master algorithm for a set of initialized simulations.
+ *
+ * The outputs of the sources are read once, so that the first step already
+ * receives the values of the start time.
+ *
+ * @param fmus Function table of each instance
+ * @param states Simulation of each instance
+ * @param nInstances Number of instances
+ * @param connections Connections, output and input holding indices in the
+ *        variables table of the model of their instance. An input is connected
+ *        at most once and STRING variables are not allowed.
+ * @param nConnections Number of connections
+ * @param jacobi 1 for Jacobi, 0 for Gauss-Seidel
+ * @return The master algorithm, NULL on allocation failure or if an FMU fails
+ */
+static Master *masterNew(FMU **fmus, SimulationState **states, int nInstances,
+                         const Connection *connections, int nConnections, int jacobi) {
+    Master *master = (Master*)calloc(1, sizeof(Master));
+    if (!master) return NULL;
+    master->nInstances = nInstances;
+    master->nConnections = nConnections;
+    master->jacobi = jacobi;
+    #if MICROPY_PY_THREAD
+    monitorInit(&master->monitor);
+    #endif
+    master->instances = (MasterInstance*)calloc(nInstances + 1, sizeof(MasterInstance));
+    master->connections = (Connection*)malloc((nConnections + 1) * sizeof(Connection));
+    master->order = (int*)calloc(nInstances + 1, sizeof(int));
+    int *inputVars = (int*)malloc((nConnections + 1) * sizeof(int));
+    int *outputVars = (int*)malloc((nConnections + 1) * sizeof(int));
+    if (!master->instances || !master->connections || !master->order || !inputVars || !outputVars) {
+        goto fail;
+    }
+    memcpy(master->connections, connections, nConnections * sizeof(Connection));
+    qsort(master->connections, nConnections, sizeof(Connection), compareConnections);
+
+    for (int i = 0; i < nInstances; i++) {
+        MasterInstance *inst = &master->instances[i];
+        inst->fmu = fmus[i];
+        inst->state = states[i];
+
+        // One input column per incoming connection, they are contiguous once sorted
+        int nInputs = 0;
+        for (int c = 0; c < nConnections; c++) {
+            Connection *conn = &master->connections[c];
+            if (conn->to != i) continue;
+            if (nInputs == 0) inst->incoming = conn;
+            inputVars[nInputs] = conn->input;
+            conn->input = nInputs++;
+        }
+        inst->nIncoming = nInputs;
+
+        // One output column per distinct connected output
+        int nOutputs = 0;
+        for (int c = 0; c < nConnections; c++) {
+            Connection *conn = &master->connections[c];
+            if (conn->from != i) continue;
+            int column = 0;
+            while (column < nOutputs && outputVars[column] != conn->output) column++;
+            if (column == nOutputs) outputVars[nOutputs++] = conn->output;
+            conn->output = column;
+        }
+
+        inst->inputValues = (double*)calloc(nInputs + 1, sizeof(double));
+        inst->outputValues = (double*)calloc(nOutputs + 1, sizeof(double));
+        if (!inst->inputValues || !inst->outputValues ||
+            buildInputMap(inst->state->variables, inputVars, nInputs, &inst->inputs) < 0 ||
+            buildInputMap(inst->state->variables, outputVars, nOutputs, &inst->outputs) < 0) {
+            goto fail;
+        }
+        if (readValues(inst->fmu, inst->state, &inst->outputs, inst->outputValues) > fmi2Warning) {
+            goto fail;
+        }
+    }
+    if (masterOrder(master) < 0) goto fail;
+
+    free(inputVars);
+    free(outputVars);
+    return master;
+
+fail:
+    free(inputVars);
+    free(outputVars);
+    masterFree(master);
+    return NULL;
+}
+
+/**
+ * @brief Copies the outputs of the sources of an instance into its inputs row.
+ */
+static void masterGather(Master *master, MasterInstance *inst) {
+    for (int k = 0; k < inst->nIncoming; k++) {
+        const Connection *conn = &inst->incoming[k];
+        inst->inputValues[conn->input] = master->instances[conn->from].outputValues[conn->output];
+    }
+}
+
+/**
+ * @brief Sets the inputs of an instance, performs one step and reads its connected outputs.
+ *
+ * @return fmi2Status Status of the step, fmi2Discard once the simulation is finished
+ */
+static fmi2Status masterStepInstance(MasterInstance *inst) {
+    fmi2Status fmi2Flag = applyInputs(inst->fmu, inst->state, &inst->inputs, inst->inputValues);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Flag = simulationDoStep(inst->fmu, inst->state);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Status readFlag = readValues(inst->fmu, inst->state, &inst->outputs, inst->outputValues);
+    return readFlag > fmi2Flag ? readFlag : fmi2Flag;
+}
+
+/**
+ * @brief Returns whether one of the coupled simulations reached its end or was terminated.
+ */
+static int masterFinished(const Master *master) {
+    for (int i = 0; i < master->nInstances; i++) {
+        const SimulationState *state = master->instances[i].state;
+        if (state->time >= state->tEnd || state->eventInfo.terminateSimulation) return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Steps the instances of the current Jacobi step until none is left.
+ *
+ * Runs on the calling thread and on the workers: each instance is taken by
+ * exactly one thread.
+ */
+static void masterJacobiWork(Master *master) {
+    for (;;) {
+        #if MICROPY_PY_THREAD
+        monitorLock(&master->monitor);
+        int i = master->nextTask < master->nInstances ? master->nextTask++ : -1;
+        monitorUnlock(&master->monitor);
+        #else
+        int i = master->nextTask < master->nInstances ? master->nextTask++ : -1;
+        #endif
+        if (i < 0) return;
+        MasterInstance *inst = &master->instances[i];
+        inst->status = masterStepInstance(inst);
+        #if MICROPY_PY_THREAD
+        monitorLock(&master->monitor);
+        // The calling thread waits for the last instance of the step
+        if (--master->pending == 0) monitorBroadcast(&master->monitor);
+        monitorUnlock(&master->monitor);
+        #endif
+    }
+}
+
+#if MICROPY_PY_THREAD
+// Entry point of the threads of the Jacobi step, which sleep between two steps
+static void *masterWorkerEntry(void *arg) {
+    Master *master = (Master*)arg;
+    int seen = 0;
+    monitorLock(&master->monitor);
+    for (;;) {
+        while (!master->stop && master->generation == seen) {
+            monitorWait(&master->monitor);
+        }
+        if (master->stop) break;
+        seen = master->generation;
+        monitorUnlock(&master->monitor);
+        masterJacobiWork(master);
+        monitorLock(&master->monitor);
+    }
+    master->nActive--;
+    monitorBroadcast(&master->monitor);
+    monitorUnlock(&master->monitor);
+    mp_thread_finish();
+    return NULL;
+}
+#endif
+
+/**
+ * @brief Performs one communication step of all the coupled instances.
+ *
+ * @param master Pointer to the master algorithm
+ * @param threaded The workers started by masterStartWorkers() take part in Jacobi steps
+ * @return fmi2Status Worst status of the instances, fmi2Discard once finished
+ */
+static fmi2Status masterDoStep(Master *master, int threaded) {
+    if (masterFinished(master)) return fmi2Discard;
+    fmi2Status status = fmi2OK;
+
+    if (master->jacobi) {
+        // All the instances receive the outputs of the previous communication point
+        for (int i = 0; i < master->nInstances; i++) {
+            masterGather(master, &master->instances[i]);
+        }
+        #if MICROPY_PY_THREAD
+        monitorLock(&master->monitor);
+        master->nextTask = 0;
+        master->pending = master->nInstances;
+        if (threaded) {
+            master->generation++;
+            monitorBroadcast(&master->monitor);
+        }
+        monitorUnlock(&master->monitor);
+        masterJacobiWork(master);
+        monitorLock(&master->monitor);
+        while (master->pending > 0) {
+            monitorWait(&master->monitor);
+        }
+        monitorUnlock(&master->monitor);
+        #else
+        (void)threaded;
+        master->nextTask = 0;
+        masterJacobiWork(master);
+        #endif
+        for (int i = 0; i < master->nInstances; i++) {
+            if (master->instances[i].status > status) status = master->instances[i].status;
+        }
+    } else {
+        // Each instance receives the outputs its sources have just computed
+        (void)threaded;
+        for (int k = 0; k < master->nInstances; k++) {
+            MasterInstance *inst = &master->instances[master->order[k]];
+            masterGather(master, inst);
+            inst->status = masterStepInstance(inst);
+            if (inst->status > status) status = inst->status;
+            if (status > fmi2Discard) break;
+        }
+    }
+
+    if (status <= fmi2Warning) master->nSteps++;
+    return status;
+}
+
+#if MICROPY_PY_THREAD
+/**
+ * @brief Stops the threads started by masterStartWorkers() and waits for them.
+ */
+static void masterStopWorkers(Master *master) {
+    monitorLock(&master->monitor);
+    master->stop = 1;
+    monitorBroadcast(&master->monitor);
+    while (master->nActive > 0) {
+        monitorWait(&master->monitor);
+    }
+    monitorUnlock(&master->monitor);
+}
+
+/**
+ * @brief Starts the threads taking part in the Jacobi steps, the calling thread being one of them.
+ *
+ * The steps must not use the MicroPython heap while the workers run. If a
+ * thread cannot be created, the ones already started are stopped before the
+ * exception is raised again.
+ */
+static void masterStartWorkers(Master *master, int nWorkers) {
+    master->stop = 0;
+    master->nActive = 0;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        for (int i = 1; i < nWorkers; i++) {
+            size_t stack_size = 0;
+            mp_thread_create(masterWorkerEntry, master, &stack_size);
+            // The workers only return once stopped, after all the increments
+            monitorLock(&master->monitor);
+            master->nActive++;
+            monitorUnlock(&master->monitor);
+        }
+        nlr_pop();
+    } else {
+        masterStopWorkers(master);
+        nlr_jump(nlr.ret_val);
+    }
+}
+#endif
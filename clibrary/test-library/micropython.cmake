@@ -21,7 +21,7 @@ add_library(usermod_clibrary INTERFACE)
 
 # Ajouter nos fichiers sources :
 target_sources(usermod_clibrary INTERFACE
-	${CMAKE_CURRENT_LIST_DIR}/main.c ${CMAKE_CURRENT_LIST_DIR}/fmu/sources/all.c
+	${CMAKE_CURRENT_LIST_DIR}/main.c
 )
 
 # AJouter le dossier en tant que "include" :
@@ -29,5 +29,35 @@ target_include_directories(usermod_clibrary INTERFACE
 	${CMAKE_CURRENT_LIST_DIR}
 )
 
+# Mesure du temps des phases renvoyé par stats() : -DFMU_PROFILE=ON pour l'activer
+option(FMU_PROFILE "Mesure du temps des phases des simulations" OFF)
+if(FMU_PROFILE)
+	target_compile_definitions(usermod_clibrary INTERFACE FMU_PROFILE=1)
+endif()
+
+# FMU compilées dans le firmware : un répertoire fmu/<modelIdentifier>/ par FMU, préparé par make prepare.
+# Chaque FMU est compilée avec le préfixe <modelIdentifier>_ sur ses fonctions FMI, puis ses autres
+# symboles sont rendus locaux pour ne pas entrer en conflit avec ceux des autres FMU.
+file(GLOB FMU_DESCRIPTIONS ${CMAKE_CURRENT_LIST_DIR}/fmu/*/modelDescription.xml)
+foreach(FMU_DESCRIPTION ${FMU_DESCRIPTIONS})
+	get_filename_component(FMU_DIR ${FMU_DESCRIPTION} DIRECTORY)
+	get_filename_component(FMU_MODEL ${FMU_DIR} NAME)
+	set(FMU_OBJECT ${CMAKE_CURRENT_BINARY_DIR}/fmu/${FMU_MODEL}.o)
+
+	add_library(fmu_${FMU_MODEL} OBJECT ${FMU_DIR}/sources/all.c)
+	target_compile_definitions(fmu_${FMU_MODEL} PRIVATE FMI_VERSION=2 MODEL_IDENTIFIER=${FMU_MODEL})
+	target_include_directories(fmu_${FMU_MODEL} PRIVATE ${FMU_DIR}/sources ${CMAKE_CURRENT_LIST_DIR}/headers)
+
+	add_custom_command(
+		OUTPUT ${FMU_OBJECT}
+		COMMAND ${CMAKE_COMMAND} -E make_directory ${CMAKE_CURRENT_BINARY_DIR}/fmu
+		COMMAND ${CMAKE_OBJCOPY} -w --keep-global-symbol=${FMU_MODEL}_fmi2* $<TARGET_OBJECTS:fmu_${FMU_MODEL}> ${FMU_OBJECT}
+		DEPENDS fmu_${FMU_MODEL} $<TARGET_OBJECTS:fmu_${FMU_MODEL}>
+		COMMENT "FMU ${FMU_MODEL}"
+	)
+	set_source_files_properties(${FMU_OBJECT} PROPERTIES EXTERNAL_OBJECT TRUE GENERATED TRUE)
+	target_sources(usermod_clibrary INTERFACE ${FMU_OBJECT})
+endforeach()
+
 # Liaison de l'INTERFACE à la cible usermod :
 target_link_libraries(usermod INTERFACE usermod_clibrary)
\ No newline at end of file
@@ -7,9 +7,39 @@ all :
 CLIBRARY_MOD_DIR := $(USERMOD_DIR)
 # Ajouter tous les fichiers C à SRC_USERMOD :
 SRC_USERMOD += $(CLIBRARY_MOD_DIR)/main.c
-SRC_USERMOD += $(CLIBRARY_MOD_DIR)/fmu/sources/all.c
 # Ajouter le chemin d'inclusion des headers C, si nécessaire
-CFLAGS_USERMOD += -I$(CLIBRARY_MOD_DIR) -I$(CLIBRARY_MOD_DIR)/headers -I$(CLIBRARY_MOD_DIR)/fmu/sources -Wall -g -DFMI_VERSION=2 -DModelFMI_COSIMULATION=0 -DMODEL_IDENTIFIER=BouncingBall -DFMI2_OVERRIDE_FUNCTION_PREFIX="" -fno-common
+CFLAGS_USERMOD += -I$(CLIBRARY_MOD_DIR) -I$(CLIBRARY_MOD_DIR)/headers -Wall -g -DFMI_VERSION=2 -fno-common
+
+# FMU compilées dans le firmware : un répertoire fmu/<modelIdentifier>/ par FMU, préparé par make prepare
+FMU_MODELS ?= $(patsubst $(CLIBRARY_MOD_DIR)/fmu/%/modelDescription.xml,%,$(wildcard $(CLIBRARY_MOD_DIR)/fmu/*/modelDescription.xml))
+FMU_OBJ = $(addprefix $(BUILD)/fmu/,$(addsuffix .o,$(FMU_MODELS)))
+PY_O += $(FMU_OBJ)
+
+# Chaque FMU est compilée avec le préfixe <modelIdentifier>_ sur ses fonctions FMI,
+# puis ses autres symboles sont rendus locaux pour ne pas entrer en conflit avec ceux des autres FMU.
+# Le code des FMU n'est pas le nôtre : ses avertissements ne bloquent pas la compilation.
+$(BUILD)/fmu/%.o: $(CLIBRARY_MOD_DIR)/fmu/%/sources/all.c
+	$(ECHO) "CC $<"
+	$(Q)$(MKDIR) -p $(dir $@)
+	$(Q)$(CC) $(CFLAGS) -Wno-error -DMODEL_IDENTIFIER=$* -I$(CLIBRARY_MOD_DIR)/fmu/$*/sources -c -o $(@:.o=.all.o) $<
+	$(Q)$(OBJCOPY) -w --keep-global-symbol='$*_fmi2*' $(@:.o=.all.o) $@
+# Interfaces compilées (les deux par défaut) : -DFMI_COSIMULATION=0 ou -DFMI_MODEL_EXCHANGE=0 pour en retirer une
+# CFLAGS_USERMOD += -DFMI_COSIMULATION=0
+
+# Chargement de FMU à l'exécution (load_fmu) : port unix sous Linux, FMU_DLOPEN=0 pour le désactiver
+ifeq ($(UNAME_S),Linux)
+FMU_DLOPEN ?= 1
+endif
+ifeq ($(FMU_DLOPEN),1)
+CFLAGS_USERMOD += -DFMU_DLOPEN=1
+LDFLAGS_USERMOD += -ldl
+endif
+
+# Mesure du temps des phases renvoyé par stats() : FMU_PROFILE=1 pour l'activer
+FMU_PROFILE ?= 0
+ifeq ($(FMU_PROFILE),1)
+CFLAGS_USERMOD += -DFMU_PROFILE=1
+endif
 
 
 
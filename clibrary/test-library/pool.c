@@ -0,0 +1,148 @@
+/**
+ * @file pool.c
+ * @brief Pool of warm FMU instances, recycled with fmi2Reset between simulations.
+ *
+ * When a simulation ends, its instance is reset and kept by the pool of its
+ * model instead of being freed. The next simulation of the same model and
+ * interface takes it back and only runs fmi2SetupExperiment and
+ * fmi2EnterInitializationMode, saving fmi2Instantiate and fmi2FreeInstance.
+ * The pool is shared by the threads of a sweep.
+ *
+ * Instances allocating from an arena are not pooled: fmi2Reset keeps their
+ * memory, and the arena is reset wholesale when the instance is freed.
+ *
+ * Included by main.c, before the models.
+ */
+
+// Instance kept by a pool, with the callbacks it keeps a pointer to
+typedef struct {
+    fmi2Component component;
+    fmi2CallbackFunctions *callbacks;
+    int coSimulation;                // instantiated for Co-Simulation
+} PooledInstance;
+
+// Structure to hold the reset instances of a model
+typedef struct {
+    PooledInstance *instances;       // reset instances, ready to be initialized
+    int count;                       // number of instances
+    int capacity;                    // largest number of instances kept
+    size_t hits;                     // simulations started from a pooled instance
+    size_t misses;                   // simulations that had to instantiate the FMU
+    size_t discarded;                // instances freed because the pool was full or fmi2Reset failed
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_t mutex;
+    #endif
+} InstancePool;
+
+static void poolLock(InstancePool *pool) {
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_lock(&pool->mutex, 1);
+    #else
+    (void)pool;
+    #endif
+}
+
+static void poolUnlock(InstancePool *pool) {
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_unlock(&pool->mutex);
+    #else
+    (void)pool;
+    #endif
+}
+
+/**
+ * @brief Frees a pooled instance.
+ */
+static void poolFreeInstance(FMU *fmu, PooledInstance *instance) {
+    fmu->freeInstance(instance->component);
+    free(instance->callbacks);
+}
+
+/**
+ * @brief Creates an empty pool.
+ *
+ * @return The pool, NULL on allocation failure
+ */
+static InstancePool *poolNew(void) {
+    InstancePool *pool = (InstancePool*)calloc(1, sizeof(InstancePool));
+    if (!pool) return NULL;
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_init(&pool->mutex);
+    #endif
+    return pool;
+}
+
+/**
+ * @brief Changes the number of instances a pool keeps, freeing the extra ones.
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int poolResize(InstancePool *pool, FMU *fmu, int capacity) {
+    poolLock(pool);
+    while (pool->count > capacity) {
+        poolFreeInstance(fmu, &pool->instances[--pool->count]);
+    }
+    PooledInstance *instances = (PooledInstance*)realloc(pool->instances, (capacity + 1) * sizeof(PooledInstance));
+    if (!instances) {
+        poolUnlock(pool);
+        return -1;
+    }
+    pool->instances = instances;
+    pool->capacity = capacity;
+    poolUnlock(pool);
+    return 0;
+}
+
+/**
+ * @brief Frees a pool and its instances, before the FMU is unloaded.
+ */
+static void poolFree(InstancePool *pool, FMU *fmu) {
+    if (!pool) return;
+    for (int i = 0; i < pool->count; i++) {
+        poolFreeInstance(fmu, &pool->instances[i]);
+    }
+    free(pool->instances);
+    free(pool);
+}
+
+/**
+ * @brief Takes a reset instance of the given interface out of a pool.
+ *
+ * @param instance Set to the instance on a hit
+ * @return 1 on a hit, 0 on a miss
+ */
+static int poolTake(InstancePool *pool, int coSimulation, PooledInstance *instance) {
+    int hit = 0;
+    poolLock(pool);
+    for (int i = pool->count - 1; i >= 0; i--) {
+        if (pool->instances[i].coSimulation == coSimulation) {
+            *instance = pool->instances[i];
+            pool->instances[i] = pool->instances[--pool->count];
+            hit = 1;
+            break;
+        }
+    }
+    if (hit) pool->hits++;
+    else pool->misses++;
+    poolUnlock(pool);
+    return hit;
+}
+
+/**
+ * @brief Resets an instance and gives it to a pool, or frees it if the pool is full.
+ *
+ * The instance must no longer be used by the caller in either case.
+ */
+static void poolPut(InstancePool *pool, FMU *fmu, PooledInstance *instance) {
+    int kept = 0;
+    poolLock(pool);
+    if (pool->count < pool->capacity && fmu->reset &&
+        fmu->reset(instance->component) <= fmi2Warning) {
+        pool->instances[pool->count++] = *instance;
+        kept = 1;
+    } else {
+        pool->discarded++;
+    }
+    poolUnlock(pool);
+    if (!kept) poolFreeInstance(fmu, instance);
+}
@@ -0,0 +1,77 @@
+/**
+ * @file profile.c
+ * @brief Call counts and cumulative times of the phases of a simulation, returned by stats().
+ *
+ * The FMU calls of interest are wrapped in PROFILE(), which always counts them.
+ * Their times are measured with clock_gettime() on POSIX systems and
+ * mp_hal_ticks_us() elsewhere, only with FMU_PROFILE=1 on the make command
+ * line (-DFMU_PROFILE=ON with cmake): by default the hot path reads no clock
+ * and the times stay 0.
+ *
+ * Included by main.c, before solver.c.
+ */
+#include <stdint.h>
+#include <time.h>
+
+#ifndef FMU_PROFILE
+#define FMU_PROFILE (0)
+#endif
+
+// Phases of a simulation step
+typedef enum {
+    PROFILE_STEP,                    // whole simulation steps, including the phases below
+    PROFILE_DERIVATIVES,             // fmi2GetDerivatives
+    PROFILE_EVENT_INDICATORS,        // fmi2GetEventIndicators
+    PROFILE_DISCRETE_STATES,         // fmi2NewDiscreteStates
+    PROFILE_DO_STEP,                 // fmi2DoStep
+    PROFILE_SAMPLING,                // reading the recorded outputs
+    PROFILE_BOXING,                  // converting the outputs into Python objects
+    PROFILE_PHASES
+} ProfilePhase;
+
+// Structure to hold the counters of a simulation
+typedef struct {
+    uint32_t calls[PROFILE_PHASES];  // number of calls
+    uint64_t time[PROFILE_PHASES];   // cumulative time, in PROFILE_TICKS_PER_US units
+} Profile;
+
+#if defined(CLOCK_MONOTONIC) && (defined(__unix__) || defined(__APPLE__))
+#define PROFILE_TICKS_PER_US 1000
+typedef uint64_t ProfileTicks;
+
+static inline ProfileTicks profileNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#else
+#define PROFILE_TICKS_PER_US 1
+// Wraps around at the width of mp_uint_t, the differences stay correct
+typedef mp_uint_t ProfileTicks;
+
+static inline ProfileTicks profileNow(void) {
+    return mp_hal_ticks_us();
+}
+#endif
+
+/**
+ * @brief Adds a call started at start to the counters of a phase.
+ */
+static inline void profileAdd(Profile *profile, ProfilePhase phase, ProfileTicks start) {
+    ProfileTicks elapsed = profileNow() - start;
+    profile->calls[phase]++;
+    profile->time[phase] += elapsed;
+}
+
+#if FMU_PROFILE
+#define PROFILE(profile, phase, statement) do { \
+        ProfileTicks profileStart_ = profileNow(); \
+        statement; \
+        profileAdd((profile), (phase), profileStart_); \
+    } while (0)
+#else
+#define PROFILE(profile, phase, statement) do { \
+        statement; \
+        (profile)->calls[(phase)]++; \
+    } while (0)
+#endif
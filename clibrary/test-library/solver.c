@@ -0,0 +1,762 @@
+/**
+ * @file solver.c
+ * @brief Integrators of the Model Exchange loop of the simulator.
+ *
+ * Each integrator drives the FMU through fmi2SetTime, fmi2SetContinuousStates
+ * and fmi2GetDerivatives. Also holds the colouring of the BDF Jacobian and the
+ * Hermite interpolation of the dense output.
+ *
+ * Included by main.c, after profile.c.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "headers/fmi2TypesPlatform.h"
+#include "headers/fmi2FunctionTypes.h"
+#include "headers/fmi2Functions.h"
+
+typedef enum {
+    SOLVER_EULER,                    // explicit Euler, one step per call
+    SOLVER_RK4,                      // classic Runge-Kutta 4, one step per call
+    SOLVER_DOPRI5,                   // adaptive Dormand-Prince 5(4) with error control
+    SOLVER_BDF                       // implicit BDF1/BDF2 with Newton iterations, for stiff models
+} SolverType;
+
+#define SOLVER_STAGES 7
+#define SOLVER_MAX_NEWTON 8
+
+// Structure to hold the integrator state and work arrays
+typedef struct {
+    SolverType type;
+    int nx;                          // number of continuous states
+    double rtol;                     // relative tolerance
+    double atol;                     // absolute tolerance
+    double hNext;                    // next internal step, 0 when only bounded by the caller
+    double hPrev;                    // last accepted step (BDF)
+    int history;                     // BDF: 1 when xPrev holds the previous point
+    int fsal;                        // dopri5: the last stage k[6] holds the derivatives where the FMU is
+    double *k[SOLVER_STAGES];        // stage derivatives
+    double *xStage;                  // state at the current stage
+    double *xNew;                    // candidate state at the end of the step
+    double *xPrev;                   // previous accepted state (BDF)
+    double *xPrevSave;               // copy of xPrev while a step is rolled back
+    double *xdotSub;                 // derivatives inside a rolled back step
+    double *dfdx;                    // state Jacobian, row-major nx * nx, kept across steps (BDF)
+    int jacValid;                    // 1 when dfdx holds a Jacobian of the current trajectory
+    double *jac;                     // LU factors of the iteration matrix I - gamma * dfdx (BDF)
+    int *pivots;                     // LU pivots of the iteration matrix (BDF)
+    double gamma;                    // gamma of the factored iteration matrix, 0 when none
+    const int *jacRows;              // Jacobian pattern of the model, NULL for a dense Jacobian (BDF)
+    const int *jacColumns;           // states each derivative depends on, see ModelDescription
+    int *colour;                     // colour of each column, columns of a colour share no row
+    int nColours;                    // number of colours, evaluations per Jacobian
+    fmi2ValueReference *stateVr;     // value references for fmi2GetDirectionalDerivative,
+    fmi2ValueReference *derivativeVr; // NULL to use finite differences
+    int nDerivatives;                // number of derivative evaluations
+    int nJacobians;                  // number of Jacobian evaluations
+    int nRejected;                   // number of rejected steps
+    Profile *profile;                // call counts and times of the simulation
+} Solver;
+
+/**
+ * @brief Frees the work arrays of an integrator.
+ *
+ * @param s Pointer to the integrator
+ */
+static void solverFree(Solver *s) {
+    for (int i = 0; i < SOLVER_STAGES; i++) {
+        if (s->k[i]) free(s->k[i]);
+        s->k[i] = NULL;
+    }
+    if (s->xStage) free(s->xStage);
+    if (s->xNew) free(s->xNew);
+    if (s->xPrev) free(s->xPrev);
+    if (s->xPrevSave) free(s->xPrevSave);
+    if (s->xdotSub) free(s->xdotSub);
+    if (s->dfdx) free(s->dfdx);
+    if (s->jac) free(s->jac);
+    if (s->pivots) free(s->pivots);
+    if (s->colour) free(s->colour);
+    if (s->stateVr) free(s->stateVr);
+    if (s->derivativeVr) free(s->derivativeVr);
+    s->xStage = s->xNew = s->xPrev = s->xPrevSave = s->xdotSub = s->dfdx = s->jac = NULL;
+    s->pivots = s->colour = NULL;
+    s->stateVr = s->derivativeVr = NULL;
+}
+
+/**
+ * @brief Allocates the work arrays of an integrator.
+ *
+ * @param s Pointer to the integrator
+ * @param type Integration method
+ * @param nx Number of continuous states
+ * @param rtol Relative tolerance of the adaptive and implicit methods
+ * @return 0 on success, -1 on allocation failure
+ */
+static int solverInit(Solver *s, SolverType type, int nx, double rtol) {
+    memset(s, 0, sizeof(Solver));
+    s->type = type;
+    s->nx = nx;
+    s->rtol = rtol;
+    s->atol = rtol * 1e-2;
+
+    for (int i = 0; i < SOLVER_STAGES; i++) {
+        s->k[i] = (double*)calloc(nx + 1, sizeof(double));
+        if (!s->k[i]) return -1;
+    }
+    s->xStage = (double*)calloc(nx + 1, sizeof(double));
+    s->xNew = (double*)calloc(nx + 1, sizeof(double));
+    s->xPrev = (double*)calloc(nx + 1, sizeof(double));
+    s->xPrevSave = (double*)calloc(nx + 1, sizeof(double));
+    s->xdotSub = (double*)calloc(nx + 1, sizeof(double));
+    if (!s->xStage || !s->xNew || !s->xPrev || !s->xPrevSave || !s->xdotSub) return -1;
+
+    if (type == SOLVER_BDF) {
+        s->dfdx = (double*)calloc(nx * nx + 1, sizeof(double));
+        s->jac = (double*)calloc(nx * nx + 1, sizeof(double));
+        s->pivots = (int*)calloc(nx + 1, sizeof(int));
+        if (!s->dfdx || !s->jac || !s->pivots) return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Gives the Jacobian pattern of the model to the BDF integrator and colours its columns.
+ *
+ * Columns which have no row in common get the same colour, with a greedy
+ * colouring in column order: the Jacobian is then evaluated with one
+ * directional derivative, or one finite difference perturbing all the
+ * columns of a colour at once, per colour instead of per state.
+ *
+ * @param s Pointer to the integrator, initialized by solverInit()
+ * @param rows Start of the states of each derivative in columns, nx + 1 values
+ * @param columns States each derivative depends on
+ * @param stateVr Value references of the states, NULL to use finite differences
+ * @param derivativeVr Value references of the derivatives, NULL to use finite differences
+ * @return 0 on success, -1 on allocation failure
+ */
+static int solverSetJacobian(Solver *s, const int *rows, const int *columns,
+                             const fmi2ValueReference *stateVr, const fmi2ValueReference *derivativeVr) {
+    int n = s->nx;
+    if (s->type != SOLVER_BDF) return 0;
+    s->colour = (int*)calloc(n + 1, sizeof(int));
+    int *last = (int*)calloc(n + 1, sizeof(int));
+    int *columnStart = (int*)calloc(n + 2, sizeof(int));
+    int *columnRows = (int*)calloc(rows[n] + 1, sizeof(int));
+    if (!s->colour || !last || !columnStart || !columnRows) {
+        free(last);
+        free(columnStart);
+        free(columnRows);
+        return -1;
+    }
+
+    // Rows of each column
+    for (int k = 0; k < rows[n]; k++) columnStart[columns[k] + 2]++;
+    for (int j = 0; j < n; j++) columnStart[j + 2] += columnStart[j + 1];
+    for (int i = 0; i < n; i++) {
+        for (int k = rows[i]; k < rows[i + 1]; k++) columnRows[columnStart[columns[k] + 1]++] = i;
+    }
+
+    // last[c] is the last column that found colour c taken by a neighbour
+    for (int c = 0; c < n; c++) last[c] = -1;
+    s->nColours = 0;
+    for (int j = 0; j < n; j++) {
+        for (int k = columnStart[j]; k < columnStart[j + 1]; k++) {
+            int i = columnRows[k];
+            for (int l = rows[i]; l < rows[i + 1]; l++) {
+                if (columns[l] < j) last[s->colour[columns[l]]] = j;
+            }
+        }
+        int c = 0;
+        while (last[c] == j) c++;
+        s->colour[j] = c;
+        if (c + 1 > s->nColours) s->nColours = c + 1;
+    }
+    free(last);
+    free(columnStart);
+    free(columnRows);
+
+    s->jacRows = rows;
+    s->jacColumns = columns;
+    if (stateVr && derivativeVr) {
+        s->stateVr = (fmi2ValueReference*)malloc((n + 1) * sizeof(fmi2ValueReference));
+        s->derivativeVr = (fmi2ValueReference*)malloc((n + 1) * sizeof(fmi2ValueReference));
+        if (!s->stateVr || !s->derivativeVr) return -1;
+        memcpy(s->stateVr, stateVr, n * sizeof(fmi2ValueReference));
+        memcpy(s->derivativeVr, derivativeVr, n * sizeof(fmi2ValueReference));
+    }
+    return 0;
+}
+
+/**
+ * @brief Forgets the step history, to be called after an event changed the states.
+ *
+ * @param s Pointer to the integrator
+ */
+static void solverReset(Solver *s) {
+    s->history = 0;
+    s->hPrev = 0;
+    s->fsal = 0;
+    s->jacValid = 0;
+    s->gamma = 0;
+}
+
+/**
+ * @brief Forgets the derivatives of the last step, to be called when the inputs of the FMU are set.
+ *
+ * @param s Pointer to the integrator
+ */
+static void solverForgetDerivatives(Solver *s) {
+    s->fsal = 0;
+}
+
+/**
+ * @brief Evaluates the derivatives of the FMU at a given time and state.
+ *
+ * The FMU is left at (t, x).
+ */
+static fmi2Status solverDerivatives(Solver *s, FMU *fmu, fmi2Component c,
+                                    double t, const double *x, double *xdot) {
+    fmi2Status fmi2Flag = fmu->setTime(c, t);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    fmi2Flag = fmu->setContinuousStates(c, x, s->nx);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    s->nDerivatives++;
+    PROFILE(s->profile, PROFILE_DERIVATIVES, fmi2Flag = fmu->getDerivatives(c, xdot, s->nx));
+    return fmi2Flag;
+}
+
+/**
+ * @brief Moves the FMU to the accepted point (t, x) without evaluating it.
+ */
+static fmi2Status solverCommit(Solver *s, FMU *fmu, fmi2Component c, double t, const double *x) {
+    fmi2Status fmi2Flag = fmu->setTime(c, t);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    return fmu->setContinuousStates(c, x, s->nx);
+}
+
+/**
+ * @brief Weighted root mean square norm used by the error and Newton tests.
+ */
+static double solverNorm(const Solver *s, const double *v, const double *x, const double *y) {
+    double sum = 0;
+    for (int i = 0; i < s->nx; i++) {
+        double scale = s->atol + s->rtol * fmax(fabs(x[i]), fabs(y[i]));
+        sum += (v[i] / scale) * (v[i] / scale);
+    }
+    return s->nx > 0 ? sqrt(sum / s->nx) : 0;
+}
+
+// Forward Euler: x(t+dt) = x(t) + dt * xdot(t)
+static fmi2Status solverStepEuler(Solver *s, FMU *fmu, fmi2Component c,
+                                  double *t, double *x, const double *xdot, double tMax) {
+    double dt = tMax - *t;
+    *t = tMax;
+    fmi2Status fmi2Flag = fmu->setTime(c, *t);
+    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+    for (int i = 0; i < s->nx; i++) {
+        x[i] += dt * xdot[i];
+    }
+    return fmu->setContinuousStates(c, x, s->nx);
+}
+
+// Classic fourth order Runge-Kutta
+static fmi2Status solverStepRK4(Solver *s, FMU *fmu, fmi2Component c,
+                                double *t, double *x, const double *xdot, double tMax) {
+    double dt = tMax - *t;
+    static const double a[3] = {0.5, 0.5, 1.0};
+    const double *k1 = xdot;
+    fmi2Status fmi2Flag;
+
+    const double *kPrev = k1;
+    for (int stage = 0; stage < 3; stage++) {
+        for (int i = 0; i < s->nx; i++) {
+            s->xStage[i] = x[i] + a[stage] * dt * kPrev[i];
+        }
+        fmi2Flag = solverDerivatives(s, fmu, c, *t + a[stage] * dt, s->xStage, s->k[stage + 1]);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        kPrev = s->k[stage + 1];
+    }
+
+    for (int i = 0; i < s->nx; i++) {
+        x[i] += dt / 6.0 * (k1[i] + 2.0 * s->k[1][i] + 2.0 * s->k[2][i] + s->k[3][i]);
+    }
+    *t = tMax;
+    return solverCommit(s, fmu, c, *t, x);
+}
+
+// Dormand-Prince 5(4) tableau
+static const double dopriC[SOLVER_STAGES] = {0.0, 1.0/5, 3.0/10, 4.0/5, 8.0/9, 1.0, 1.0};
+static const double dopriA[SOLVER_STAGES][SOLVER_STAGES - 1] = {
+    {0},
+    {1.0/5},
+    {3.0/40, 9.0/40},
+    {44.0/45, -56.0/15, 32.0/9},
+    {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+    {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+    {35.0/384, 0.0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84},
+};
+// Difference between the 5th and 4th order weights
+static const double dopriE[SOLVER_STAGES] = {
+    71.0/57600, 0.0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40
+};
+
+// Adaptive Dormand-Prince 5(4): retries with a smaller step until the local error is accepted
+static fmi2Status solverStepDopri(Solver *s, FMU *fmu, fmi2Component c,
+                                  double *t, double *x, const double *xdot, double tMax) {
+    fmi2Status fmi2Flag;
+    memcpy(s->k[0], xdot, s->nx * sizeof(double));
+    s->fsal = 0;
+
+    for (;;) {
+        double remaining = tMax - *t;
+        double dt = (s->hNext > 0 && s->hNext < remaining) ? s->hNext : remaining;
+        double hMin = 1e-12 * fmax(fabs(*t), 1.0);
+        double tNew = (dt < remaining) ? *t + dt : tMax;
+
+        for (int stage = 1; stage < SOLVER_STAGES; stage++) {
+            double *xs = (stage == SOLVER_STAGES - 1) ? s->xNew : s->xStage;
+            for (int i = 0; i < s->nx; i++) {
+                double sum = 0;
+                for (int j = 0; j < stage; j++) {
+                    sum += dopriA[stage][j] * s->k[j][i];
+                }
+                xs[i] = x[i] + dt * sum;
+            }
+            // The last stage is at the end of the step, reused by solverEndDerivatives()
+            double ts = (stage == SOLVER_STAGES - 1) ? tNew : *t + dopriC[stage] * dt;
+            fmi2Flag = solverDerivatives(s, fmu, c, ts, xs, s->k[stage]);
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        }
+
+        // Local error estimate of the 4th order solution
+        for (int i = 0; i < s->nx; i++) {
+            double e = 0;
+            for (int j = 0; j < SOLVER_STAGES; j++) {
+                e += dopriE[j] * s->k[j][i];
+            }
+            s->xStage[i] = dt * e;
+        }
+        double err = solverNorm(s, s->xStage, x, s->xNew);
+        double factor = err > 0 ? 0.9 * pow(err, -0.2) : 5.0;
+        factor = fmin(5.0, fmax(0.2, factor));
+
+        if (err <= 1.0 || dt <= hMin) {
+            // The last stage was evaluated at (t + dt, xNew): the FMU is already there
+            memcpy(x, s->xNew, s->nx * sizeof(double));
+            *t = tNew;
+            s->fsal = 1;
+            // A step clipped by the caller does not say anything about the next one
+            if (dt < remaining || s->hNext <= 0 || dt * factor > s->hNext) {
+                s->hNext = dt * factor;
+            }
+            return fmi2OK;
+        }
+        s->nRejected++;
+        s->hNext = dt * factor;
+    }
+}
+
+/**
+ * @brief LU factorization with partial pivoting of a row-major n * n matrix.
+ *
+ * @return 0 on success, -1 if the matrix is singular
+ */
+static int solverLU(double *a, int *pivots, int n) {
+    for (int k = 0; k < n; k++) {
+        int p = k;
+        for (int i = k + 1; i < n; i++) {
+            if (fabs(a[i * n + k]) > fabs(a[p * n + k])) p = i;
+        }
+        pivots[k] = p;
+        if (a[p * n + k] == 0.0) return -1;
+        if (p != k) {
+            for (int j = 0; j < n; j++) {
+                double tmp = a[k * n + j];
+                a[k * n + j] = a[p * n + j];
+                a[p * n + j] = tmp;
+            }
+        }
+        for (int i = k + 1; i < n; i++) {
+            double l = a[i * n + k] / a[k * n + k];
+            a[i * n + k] = l;
+            for (int j = k + 1; j < n; j++) {
+                a[i * n + j] -= l * a[k * n + j];
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Solves a * x = b in place, a being factorized by solverLU().
+ */
+static void solverLUSolve(const double *a, const int *pivots, double *b, int n) {
+    for (int k = 0; k < n; k++) {
+        if (pivots[k] != k) {
+            double tmp = b[k];
+            b[k] = b[pivots[k]];
+            b[pivots[k]] = tmp;
+        }
+        for (int i = k + 1; i < n; i++) {
+            b[i] -= a[i * n + k] * b[k];
+        }
+    }
+    for (int k = n - 1; k >= 0; k--) {
+        for (int j = k + 1; j < n; j++) {
+            b[k] -= a[k * n + j] * b[j];
+        }
+        b[k] /= a[k * n + k];
+    }
+}
+
+/**
+ * @brief Evaluates the Jacobian one colour at a time, into the pattern entries of s->dfdx.
+ *
+ * With value references, each colour is one fmi2GetDirectionalDerivative call
+ * seeded with the columns of the colour; otherwise these columns are
+ * perturbed together for one finite difference. The FMU is at (t, y) on entry.
+ */
+static fmi2Status solverColouredJacobian(Solver *s, FMU *fmu, fmi2Component c,
+                                         double t, double *y, const double *f0) {
+    int n = s->nx;
+    double *seed = s->k[4];
+    double *delta = s->k[5];
+    double *f1 = s->k[6];
+    memset(s->dfdx, 0, n * n * sizeof(double));
+
+    for (int colour = 0; colour < s->nColours; colour++) {
+        fmi2Status fmi2Flag;
+        if (s->stateVr) {
+            for (int j = 0; j < n; j++) {
+                seed[j] = s->colour[j] == colour ? 1.0 : 0.0;
+            }
+            fmi2Flag = fmu->getDirectionalDerivative(c, s->derivativeVr, n, s->stateVr, n, seed, f1);
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+            for (int i = 0; i < n; i++) {
+                for (int k = s->jacRows[i]; k < s->jacRows[i + 1]; k++) {
+                    int j = s->jacColumns[k];
+                    if (s->colour[j] == colour) s->dfdx[i * n + j] = f1[i];
+                }
+            }
+        } else {
+            for (int j = 0; j < n; j++) {
+                delta[j] = s->colour[j] == colour ? sqrt(2.2e-16) * fmax(fabs(y[j]), 1.0) : 0.0;
+                seed[j] = y[j];
+                y[j] += delta[j];
+            }
+            fmi2Flag = solverDerivatives(s, fmu, c, t, y, f1);
+            memcpy(y, seed, n * sizeof(double));
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+            for (int i = 0; i < n; i++) {
+                for (int k = s->jacRows[i]; k < s->jacRows[i + 1]; k++) {
+                    int j = s->jacColumns[k];
+                    if (s->colour[j] == colour) s->dfdx[i * n + j] = (f1[i] - f0[i]) / delta[j];
+                }
+            }
+        }
+    }
+    return fmi2OK;
+}
+
+/**
+ * @brief Evaluates the state Jacobian at (t, y) into s->dfdx.
+ *
+ * With the Jacobian pattern of the model, the Jacobian is evaluated one colour
+ * at a time by solverColouredJacobian(). Otherwise it is approximated column
+ * by column with finite differences. f0 holds the derivatives at (t, y).
+ */
+static fmi2Status solverJacobian(Solver *s, FMU *fmu, fmi2Component c,
+                                 double t, double *y, const double *f0) {
+    int n = s->nx;
+    double *f1 = s->k[6];
+    s->nJacobians++;
+    s->jacValid = 0;
+
+    if (s->colour) {
+        fmi2Status fmi2Flag = solverColouredJacobian(s, fmu, c, t, y, f0);
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        s->jacValid = 1;
+        return fmi2OK;
+    }
+
+    for (int j = 0; j < n; j++) {
+        double yj = y[j];
+        double delta = sqrt(2.2e-16) * fmax(fabs(yj), 1.0);
+        y[j] = yj + delta;
+        fmi2Status fmi2Flag = solverDerivatives(s, fmu, c, t, y, f1);
+        y[j] = yj;
+        if (fmi2Flag > fmi2Warning) return fmi2Flag;
+        for (int i = 0; i < n; i++) {
+            s->dfdx[i * n + j] = (f1[i] - f0[i]) / delta;
+        }
+    }
+    s->jacValid = 1;
+    return fmi2OK;
+}
+
+/**
+ * @brief Factors the iteration matrix I - gamma * J, J being the state Jacobian in s->dfdx.
+ *
+ * @return 0 on success, -1 when the matrix is singular
+ */
+static int solverIterationMatrix(Solver *s, double gamma) {
+    int n = s->nx;
+    for (int i = 0; i < n * n; i++) {
+        s->jac[i] = -gamma * s->dfdx[i];
+    }
+    for (int j = 0; j < n; j++) {
+        s->jac[j * n + j] += 1.0;
+    }
+    if (solverLU(s->jac, s->pivots, n) < 0) {
+        s->gamma = 0;
+        return -1;
+    }
+    s->gamma = gamma;
+    return 0;
+}
+
+// Variable step BDF2, started with BDF1 (implicit Euler) after a reset.
+// The local truncation error is estimated from the difference between the
+// corrector and a predictor of the same order, and sizes the next step.
+// The Jacobian is kept from one step to the next and only evaluated again when
+// Newton fails with an old one; the iteration matrix is factored again when
+// gamma = beta * dt moves away from the factored one.
+static fmi2Status solverStepBDF(Solver *s, FMU *fmu, fmi2Component c,
+                                double *t, double *x, const double *xdot, double tMax) {
+    int n = s->nx;
+    double *predictor = s->k[0];
+    double *psi = s->k[1];
+    double *f = s->k[2];
+    double *delta = s->k[3];
+    double *y = s->xNew;
+    fmi2Status fmi2Flag;
+
+    for (;;) {
+        double remaining = tMax - *t;
+        double dt = (s->hNext > 0 && s->hNext < remaining) ? s->hNext : remaining;
+        double hMin = 1e-12 * fmax(fabs(*t), 1.0);
+        double tNew = (dt < remaining) ? *t + dt : tMax;
+
+        // x(t+dt) - beta * dt * f(t+dt, x(t+dt)) = psi
+        double beta = 1.0;
+        double w = 0.0;                  // ratio of the step to the previous one
+        if (s->history) {
+            w = dt / s->hPrev;
+            beta = (1.0 + w) / (1.0 + 2.0 * w);
+            for (int i = 0; i < n; i++) {
+                psi[i] = ((1.0 + w) * (1.0 + w) * x[i] - w * w * s->xPrev[i]) / (1.0 + 2.0 * w);
+            }
+        } else {
+            memcpy(psi, x, n * sizeof(double));
+        }
+
+        // Predictor of the order of the corrector: explicit Euler for BDF1, and for
+        // BDF2 the quadratic through the previous point with the current derivative
+        for (int i = 0; i < n; i++) {
+            predictor[i] = x[i] + dt * xdot[i];
+            if (s->history) {
+                double curvature = (s->xPrev[i] - x[i] + s->hPrev * xdot[i]) / (s->hPrev * s->hPrev);
+                predictor[i] += dt * dt * curvature;
+            }
+            y[i] = predictor[i];
+        }
+
+        // The errors of the FMU go back to the caller, only a failed Newton
+        // iteration makes the step smaller
+        int converged = 0;
+        int fresh = 0;                   // 1 when the Jacobian was evaluated for this step
+        double gamma = beta * dt;
+        double previousNorm = 0;
+        for (int iter = 0; iter < SOLVER_MAX_NEWTON; iter++) {
+            fmi2Flag = solverDerivatives(s, fmu, c, tNew, y, f);
+            if (fmi2Flag > fmi2Warning) return fmi2Flag;
+            if (iter == 0) {
+                if (!s->jacValid) {
+                    fmi2Flag = solverJacobian(s, fmu, c, tNew, y, f);
+                    if (fmi2Flag > fmi2Warning) return fmi2Flag;
+                    fresh = 1;
+                    s->gamma = 0;
+                }
+                double ratio = s->gamma > 0 ? gamma / s->gamma : 0;
+                if ((ratio < 0.7 || ratio > 1.3) && solverIterationMatrix(s, gamma) < 0) break;
+            }
+            for (int i = 0; i < n; i++) {
+                delta[i] = -(y[i] - gamma * f[i] - psi[i]);
+            }
+            solverLUSolve(s->jac, s->pivots, delta, n);
+            for (int i = 0; i < n; i++) {
+                y[i] += delta[i];
+            }
+            double norm = solverNorm(s, delta, x, y);
+            if (norm <= 0.1) {
+                converged = 1;
+                break;
+            }
+            // Diverging, most likely with an old Jacobian
+            if (iter > 0 && norm > 0.9 * previousNorm) break;
+            previousNorm = norm;
+        }
+
+        if (!converged && !fresh) {
+            // Same step again with the Jacobian at the new point
+            s->jacValid = 0;
+            continue;
+        }
+        if (!converged) {
+            if (dt <= hMin) return fmi2Error;
+            s->nRejected++;
+            s->hNext = dt / 4.0;
+            continue;
+        }
+
+        // Local truncation error, (1 + w) / (2 + 3w) times the predictor-corrector
+        // difference: 2/5 for BDF2 at a constant step, 1/2 for BDF1 (w = 0)
+        double errorConstant = (1.0 + w) / (2.0 + 3.0 * w);
+        for (int i = 0; i < n; i++) {
+            delta[i] = errorConstant * (y[i] - predictor[i]);
+        }
+        double err = solverNorm(s, delta, x, y);
+        double factor = err > 0 ? 0.9 * pow(err, s->history ? -1.0 / 3 : -0.5) : 2.0;
+        // Variable step BDF2 stays zero-stable for step ratios below 1 + sqrt(2). A
+        // rejected step may shrink further: after a restart, the first implicit
+        // Euler step is the whole interval given by the caller.
+        factor = fmin(2.0, fmax(err <= 1.0 ? 0.2 : 0.1, factor));
+
+        if (err <= 1.0 || dt <= hMin) {
+            memcpy(s->xPrev, x, n * sizeof(double));
+            memcpy(x, y, n * sizeof(double));
+            s->hPrev = dt;
+            s->history = 1;
+            *t = tNew;
+            // A step clipped by the caller does not say anything about the next one
+            if (dt < remaining || s->hNext <= 0 || dt * factor > s->hNext) {
+                s->hNext = dt * factor;
+            }
+            return solverCommit(s, fmu, c, *t, x);
+        }
+        s->nRejected++;
+        s->hNext = dt * factor;
+    }
+}
+
+/**
+ * @brief Performs one accepted integration step from (*t, x) towards tMax.
+ *
+ * The fixed step methods always reach tMax. The adaptive and implicit methods
+ * may stop earlier when the step has to be reduced; the caller then calls
+ * solverStep again from the new point. On return the FMU is at (*t, x).
+ *
+ * @param s Pointer to the integrator
+ * @param fmu Pointer to the FMU structure
+ * @param c FMU component
+ * @param t Current time, updated to the end of the step
+ * @param x Current continuous states, updated to the end of the step
+ * @param xdot Derivatives at (*t, x)
+ * @param tMax Time the step must not go beyond
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status solverStep(Solver *s, FMU *fmu, fmi2Component c,
+                             double *t, double *x, const double *xdot, double tMax) {
+    switch (s->type) {
+        case SOLVER_RK4: return solverStepRK4(s, fmu, c, t, x, xdot, tMax);
+        case SOLVER_DOPRI5: return solverStepDopri(s, fmu, c, t, x, xdot, tMax);
+        case SOLVER_BDF: return solverStepBDF(s, fmu, c, t, x, xdot, tMax);
+        default: return solverStepEuler(s, fmu, c, t, x, xdot, tMax);
+    }
+}
+
+/**
+ * @brief Returns the derivatives at the end of the last step, if the integrator evaluated them there.
+ *
+ * The last stage of Dormand-Prince is evaluated at the accepted point (first
+ * same as last): the next step can start from it without calling
+ * fmi2GetDerivatives. They are forgotten by solverReset() and
+ * solverForgetDerivatives(), whenever the FMU is changed between two steps.
+ *
+ * @param s Pointer to the integrator
+ * @return The derivatives at the current point of the FMU, NULL if they have to be evaluated
+ */
+static const double *solverEndDerivatives(const Solver *s) {
+    return s->fsal ? s->k[SOLVER_STAGES - 1] : NULL;
+}
+
+/**
+ * @brief Interpolates the continuous states inside an accepted step, for dense output.
+ *
+ * Cubic Hermite interpolation between the states and derivatives at both ends
+ * of the step [t0, t1]: third order accurate, continuous from one step to the
+ * next, and without any evaluation of the FMU.
+ *
+ * @param nx Number of continuous states
+ * @param t0 Start time of the step
+ * @param x0 Continuous states at t0
+ * @param xdot0 Derivatives at (t0, x0)
+ * @param t1 End time of the step
+ * @param x1 Continuous states at t1
+ * @param xdot1 Derivatives at (t1, x1)
+ * @param t Time to interpolate at, in [t0, t1]
+ * @param x Set to the continuous states at t
+ */
+static void solverHermite(int nx, double t0, const double *x0, const double *xdot0,
+                          double t1, const double *x1, const double *xdot1, double t, double *x) {
+    double dt = t1 - t0;
+    double u = dt > 0 ? (t - t0) / dt : 1.0;
+    double h00 = (1.0 + 2.0 * u) * (1.0 - u) * (1.0 - u);
+    double h10 = u * (1.0 - u) * (1.0 - u);
+    double h01 = u * u * (3.0 - 2.0 * u);
+    double h11 = u * u * (u - 1.0);
+    for (int i = 0; i < nx; i++) {
+        x[i] = h00 * x0[i] + h10 * dt * xdot0[i] + h01 * x1[i] + h11 * dt * xdot1[i];
+    }
+}
+
+/**
+ * @brief Re-integrates a step from (t0, x0) up to tEnd, leaving the integrator history untouched.
+ *
+ * Used to roll the continuous states back to the start of an accepted step and
+ * evaluate them at an earlier time, e.g. when locating a state event. On return
+ * the FMU is at (tEnd, x).
+ *
+ * @param s Pointer to the integrator
+ * @param fmu Pointer to the FMU structure
+ * @param c FMU component
+ * @param t0 Start time of the step
+ * @param x0 Continuous states at t0
+ * @param xdot0 Derivatives at (t0, x0)
+ * @param tEnd Time to integrate to
+ * @param x Set to the continuous states at tEnd
+ * @return fmi2Status Worst status returned by the FMU
+ */
+static fmi2Status solverStepTo(Solver *s, FMU *fmu, fmi2Component c, double t0,
+                               const double *x0, const double *xdot0, double tEnd, double *x) {
+    double hNext = s->hNext, hPrev = s->hPrev;
+    int history = s->history;
+    memcpy(s->xPrevSave, s->xPrev, s->nx * sizeof(double));
+    memcpy(x, x0, s->nx * sizeof(double));
+
+    fmi2Status fmi2Flag = fmi2OK;
+    double t = t0;
+    const double *xdot = xdot0;
+    // The BDF history now ends at the accepted step: restart with implicit Euler
+    s->history = 0;
+    s->hNext = 0;
+    while (t < tEnd) {
+        if (t > t0) {
+            xdot = solverEndDerivatives(s);
+            if (!xdot) {
+                PROFILE(s->profile, PROFILE_DERIVATIVES, fmi2Flag = fmu->getDerivatives(c, s->xdotSub, s->nx));
+                if (fmi2Flag > fmi2Warning) break;
+                xdot = s->xdotSub;
+            }
+        }
+        fmi2Flag = solverStep(s, fmu, c, &t, x, xdot, tEnd);
+        if (fmi2Flag > fmi2Warning) break;
+    }
+
+    s->hNext = hNext;
+    s->hPrev = hPrev;
+    s->history = history;
+    memcpy(s->xPrev, s->xPrevSave, s->nx * sizeof(double));
+    return fmi2Flag;
+}
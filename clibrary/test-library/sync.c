@@ -0,0 +1,99 @@
+/**
+ * @file sync.c
+ * @brief Monitor (mutex and condition) for the worker threads of sweep() and of the master algorithm.
+ *
+ * MicroPython only gives mutexes to C modules. On POSIX systems a monitor is
+ * a pthread mutex and condition variable, so a waiting thread sleeps until it
+ * is woken up. Elsewhere, -DFMU_PTHREAD=0, it is the MicroPython mutex, and a
+ * waiting thread releases it and sleeps SYNC_POLL_US between two checks.
+ *
+ * Included by main.c, before the models.
+ */
+#if MICROPY_PY_THREAD
+
+#ifndef FMU_PTHREAD
+#if defined(__unix__) || defined(__APPLE__)
+#define FMU_PTHREAD (1)
+#else
+#define FMU_PTHREAD (0)
+#endif
+#endif
+
+#if FMU_PTHREAD
+#include <pthread.h>
+#endif
+
+#define SYNC_POLL_US 50
+
+// Mutex and condition the threads wait on for a shared counter to change
+typedef struct {
+    #if FMU_PTHREAD
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    #else
+    mp_thread_mutex_t mutex;
+    #endif
+} Monitor;
+
+static void monitorInit(Monitor *monitor) {
+    #if FMU_PTHREAD
+    pthread_mutex_init(&monitor->mutex, NULL);
+    pthread_cond_init(&monitor->cond, NULL);
+    #else
+    mp_thread_mutex_init(&monitor->mutex);
+    #endif
+}
+
+static void monitorDestroy(Monitor *monitor) {
+    #if FMU_PTHREAD
+    pthread_cond_destroy(&monitor->cond);
+    pthread_mutex_destroy(&monitor->mutex);
+    #else
+    (void)monitor;
+    #endif
+}
+
+static void monitorLock(Monitor *monitor) {
+    #if FMU_PTHREAD
+    pthread_mutex_lock(&monitor->mutex);
+    #else
+    mp_thread_mutex_lock(&monitor->mutex, 1);
+    #endif
+}
+
+static void monitorUnlock(Monitor *monitor) {
+    #if FMU_PTHREAD
+    pthread_mutex_unlock(&monitor->mutex);
+    #else
+    mp_thread_mutex_unlock(&monitor->mutex);
+    #endif
+}
+
+/**
+ * @brief Waits for monitorBroadcast(), with the monitor locked.
+ *
+ * The monitor is locked again on return, which may also happen without a
+ * broadcast: the caller checks its condition in a loop.
+ */
+static void monitorWait(Monitor *monitor) {
+    #if FMU_PTHREAD
+    pthread_cond_wait(&monitor->cond, &monitor->mutex);
+    #else
+    mp_thread_mutex_unlock(&monitor->mutex);
+    mp_hal_delay_us(SYNC_POLL_US);
+    mp_thread_mutex_lock(&monitor->mutex, 1);
+    #endif
+}
+
+/**
+ * @brief Wakes up the threads waiting on a monitor, called with the monitor locked.
+ */
+static void monitorBroadcast(Monitor *monitor) {
+    #if FMU_PTHREAD
+    pthread_cond_broadcast(&monitor->cond);
+    #else
+    (void)monitor;
+    #endif
+}
+
+#endif
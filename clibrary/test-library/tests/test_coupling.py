@@ -0,0 +1,66 @@
+# couple : échanges de Gauss-Seidel et de Jacobi entre deux BouncingBall,
+# dont la seconde part de h = 5 et reçoit la hauteur de la première
+import FMUSimulator as F
+
+DT = 0.1
+
+
+def pair(h=5.0):
+    a = F.setup_simulation(0, 1, DT, outputs=["h", "v"])
+    b = F.setup_simulation(0, 1, DT, outputs=["h", "v"])
+    F.change_variable_value(b, "h", h)
+    return a, b
+
+
+# Sans connexion, chaque simulation avance comme seule
+a, b = pair()
+alone = list(F.setup_simulation(0, 1, DT, outputs=["h", "v"]))
+rows = list(F.couple([a, b], []))
+assert [r[0] for r in rows] == alone
+assert rows[0][1][1] > 4
+
+# Gauss-Seidel : la source avance d'abord, la destination part de la hauteur
+# qu'elle vient de calculer (Euler explicite : h + dt * v avec sa propre vitesse)
+a, b = pair()
+cp = F.couple([b, a], [(a, "h", b, "h")])
+assert cp.order() == [1, 0]
+previous = None
+for rb, ra in cp:
+    assert ra == alone[ra[0] - 1]
+    if previous is not None and ra[2] < 0 and rb[2] < 0:
+        assert abs(rb[1] - (ra[1] + DT * previous[2])) < 1e-12, (ra, rb)
+    previous = rb
+
+# Jacobi : la destination reçoit la hauteur du pas précédent, la même que la
+# sienne dès le deuxième pas puisque les vitesses sont égales
+a, b = pair()
+rows = list(F.couple([a, b], [(a, "h", b, "h")], method="jacobi"))
+assert all(ra == rb for ra, rb in rows), rows[:2]
+
+# run() sur plusieurs threads : mêmes résultats qu'avec un seul
+finals = []
+for workers in (1, 3):
+    a, b = pair()
+    c = F.setup_simulation(0, 1, DT, outputs=["h", "v"])
+    F.change_variable_value(c, "e", 0.5)
+    cp = F.couple([a, b, c], [(a, "h", b, "h"), (c, "v", a, "v")], method="jacobi", workers=workers)
+    cp.run(5)
+    finals.append(next(cp))
+    cp.close()
+assert finals[0] == finals[1], finals
+
+# Connexions invalides
+a, b = pair()
+for bad in ([(a, "h", b, "h"), (b, "h", b, "h")], [(a, "h", 5, "h")], [(a, "h", b)], [(a, "nothing", b, "h")]):
+    try:
+        F.couple([a, b], bad)
+        assert False, bad
+    except ValueError:
+        pass
+try:
+    F.couple([a, a], [])
+    assert False, "same simulation coupled twice"
+except ValueError:
+    pass
+
+print("test_coupling: OK")
@@ -0,0 +1,81 @@
+# load_fmu : une FMU chargée à l'exécution se simule comme le même modèle compilé.
+# Prend une .fmu ou un répertoire en argument, par défaut le répertoire du
+# modèle par défaut décompressé par make prepare.
+import FMUSimulator as F
+import os
+import sys
+
+if not hasattr(F, "load_fmu"):
+    print("test_load: skipped, no dlopen")
+    sys.exit()
+
+builtin = F.get_models()[0]
+path = sys.argv[1] if len(sys.argv) > 1 else "../fmu/" + builtin
+
+
+def temporary_directories():
+    return [d for d in os.listdir("/tmp") if d.startswith("fmu") and len(d) == 9]
+
+
+before = temporary_directories()
+m = F.load_fmu(path)
+# L'archive décompressée n'est gardée que pour son répertoire resources
+if path.endswith(".fmu"):
+    assert len(temporary_directories()) <= len(before) + 1
+
+names = m.get_variables_names()
+assert names[0] == "step" and len(names) == m.get_variable_count() + 1
+for k, name in enumerate(names):
+    assert m.resolve(name) == k, name
+assert m.get_variables_names(1, names[-1]) == (names[1], names[-1])
+try:
+    m.get_variables_names(len(names))
+    assert False, "index out of range accepted"
+except ValueError:
+    pass
+
+# Même modèle que le modèle compilé : mêmes variables et mêmes résultats
+compiled = None
+for identifier in F.get_models():
+    if repr(F.get_model(identifier)) == repr(m):
+        compiled = identifier
+if compiled:
+    reference = F.get_model(compiled)
+    assert m.get_variables_base_values() == reference.get_variables_base_values()
+    assert m.get_variables_description() == reference.get_variables_description()
+    for options in ({}, {"solver": "dopri5"}, {"interface": "cs"}):
+        a = F.simulate(0, 2, 0.01, model=m, **options)
+        b = F.simulate(0, 2, 0.01, model=compiled, **options)
+        assert len(a) == len(b), options
+        for ra, rb in zip(a, b):
+            assert all(abs(x - y) < 1e-9 for x, y in zip(ra, rb)), (options, ra, rb)
+
+# Les options des simulations compilées s'appliquent aux FMU chargées
+s = F.setup_simulation(0, 2, 0.01, model=m)
+for _ in range(10):
+    next(s)
+state = s.snapshot()
+after = [next(s) for _ in range(20)]
+s.restore(state)
+assert [next(s) for _ in range(20)] == after
+rows = F.sweep([{}, {}], 0, 1, 0.1, model=m, workers=2)
+assert list(rows[0]) == list(rows[1])
+
+# Une simulation garde la FMU chargée après la fermeture du Model
+m.close()
+assert next(s)[0] == 31
+s.close()
+try:
+    F.simulate(0, 1, 0.1, model=m)
+    assert False, "closed model accepted"
+except ValueError:
+    pass
+
+try:
+    F.load_fmu("/nonexistent/model.fmu")
+    assert False, "missing FMU loaded"
+except OSError:
+    pass
+assert temporary_directories() == before
+
+print("test_load: OK")
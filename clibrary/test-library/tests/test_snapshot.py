@@ -0,0 +1,61 @@
+# snapshot() et restore() : une simulation restaurée refait exactement les mêmes pas
+import FMUSimulator as F
+
+for options in ({"solver": "euler"}, {"solver": "dopri5"}, {"solver": "bdf"}, {"interface": "cs"}):
+    s = F.setup_simulation(0, 3, 0.01, outputs=["time", "h", "v"], **options)
+    for _ in range(40):
+        next(s)
+    state = s.snapshot()
+    assert isinstance(state, bytes) and len(state) > 0, options
+    after = [next(s) for _ in range(100)]
+
+    # Retour en arrière dans la même simulation, à travers des rebonds
+    s.restore(state)
+    assert s.snapshot() == state, options
+    replay = [next(s) for _ in range(100)]
+    if options.get("solver") == "bdf":
+        # restore() oublie l'historique du BDF, qui repart à l'ordre 1
+        for a, b in zip(replay, after):
+            assert a[0] == b[0] and abs(a[1] - b[1]) < 1e-6 and abs(a[2] - b[2]) < 1e-3, (options, a, b)
+    else:
+        assert replay == after, options
+
+    # Depuis une autre simulation du même modèle
+    other = F.setup_simulation(0, 3, 0.01, outputs=["time", "h", "v"], **options)
+    other.restore(state)
+    assert [next(other) for _ in range(100)] == replay, options
+
+    # Une modification après l'instantané est annulée par restore(), h n'est
+    # modifiable en cours de simulation qu'en Model Exchange
+    s.restore(state)
+    if options.get("interface") != "cs":
+        F.change_variable_value(s, "h", 5.0)
+        assert next(s)[2] > 4, options
+    else:
+        F.change_variable_value(s, "e", 0.1)
+    s.restore(state)
+    assert next(s) == replay[0], options
+    s.close()
+    other.close()
+
+# Instantané tronqué ou d'une autre forme
+s = F.setup_simulation(0, 3, 0.01)
+state = s.snapshot()
+for bad in (state[:len(state) // 2], b"\0" * len(state)):
+    try:
+        s.restore(bad)
+        assert False, "restore accepted a bad snapshot"
+    except ValueError:
+        pass
+
+# Instantané d'un autre modèle compilé
+models = F.get_models()
+if len(models) > 1:
+    other = F.setup_simulation(0, 3, 0.01, model=models[1])
+    try:
+        other.restore(state)
+        assert False, "restore accepted a snapshot of another model"
+    except ValueError:
+        pass
+
+print("test_snapshot: OK")
@@ -0,0 +1,96 @@
+# Intégrateurs et événements d'état, comparés à la solution exacte de BouncingBall
+# (h = 1, v = 0, e = 0.7, g = -9.81, le modèle par défaut)
+import FMUSimulator as F
+from math import sqrt
+
+H0, E, G, V_MIN = 1.0, 0.7, 9.81, 0.1
+
+
+# Instants des rebonds, jusqu'à l'arrêt de la balle quand v < V_MIN
+def bounces():
+    tb, h, v, times = 0.0, H0, 0.0, []
+    while True:
+        s = (v + sqrt(v * v + 2 * G * h)) / G
+        tb += s
+        times.append(tb)
+        v = (G * s - v) * E
+        h = 0.0
+        if v < V_MIN:
+            return times
+
+
+# Hauteur exacte à l'instant t
+def height(t):
+    tb, h, v = 0.0, H0, 0.0
+    while True:
+        s = (v + sqrt(v * v + 2 * G * h)) / G
+        if t < tb + s:
+            dt = t - tb
+            return h + v * dt - G * dt * dt / 2
+        tb += s
+        v = (G * s - v) * E
+        h = 0.0
+        if v < V_MIN:
+            return 0.0
+
+
+BOUNCES = bounces()
+assert len(BOUNCES) == 11, BOUNCES
+
+# Écart maximal admis sur h aux points de la grille loin des rebonds
+CASES = (
+    ({"solver": "euler"}, 0.2),
+    ({"solver": "rk4"}, 1e-6),
+    ({"solver": "dopri5"}, 1e-6),
+    ({"solver": "dopri5", "tolerance": 1e-8}, 1e-6),
+    ({"solver": "dopri5", "dense": True}, 1e-6),
+    ({"solver": "bdf"}, 1e-4),
+    ({"interface": "cs"}, 0.05),
+)
+
+for options, tolerance in CASES:
+    s = F.setup_simulation(0, 3, 0.01, outputs=["time", "h", "v"], **options)
+    rows = list(s)
+    stats = s.stats()
+    s.close()
+
+    assert all(rows[k][0] == k + 1 for k in range(len(rows))), options
+    assert all(rows[k][1] < rows[k + 1][1] for k in range(len(rows) - 1)), options
+    assert abs(rows[-1][1] - 3) < 0.01, (options, rows[-1])
+
+    error = 0
+    for row in rows:
+        t = row[1]
+        if t < BOUNCES[-1] and min(abs(t - b) for b in BOUNCES) > 0.05:
+            error = max(error, abs(row[2] - height(t)))
+    assert error < tolerance, (options, error)
+
+    if options.get("interface") == "cs":
+        assert stats["do_step"][0] >= len(rows) and stats["derivatives"][0] == 0, (options, stats)
+        continue
+
+    # Chaque rebond est un événement d'état, avec une ligne à son instant exact
+    assert stats["state_events"] == len(BOUNCES), (options, stats["state_events"])
+    if options["solver"] != "euler":
+        for b in BOUNCES:
+            assert min(abs(row[1] - b) for row in rows) < 1e-4, (options, b)
+        assert rows[-1][2] < 1e-6 and rows[-1][3] == 0, (options, rows[-1])
+    if options["solver"] == "bdf":
+        assert 0 < stats["jacobians"] < stats["steps"], (options, stats)
+
+# Les résultats en colonnes et en lignes sont ceux des tuples
+tuples = F.simulate(0, 1, 0.1, outputs=["h", "v"], solver="rk4")
+columns = F.simulate(0, 1, 0.1, outputs=["h", "v"], solver="rk4", layout="columns")
+rows = F.simulate(0, 1, 0.1, outputs=["h", "v"], solver="rk4", layout="rows")
+for k, row in enumerate(tuples):
+    assert tuple(columns[c][k] for c in range(3)) == row
+    assert tuple(rows[3 * k + c] for c in range(3)) == row
+
+for bad in ({"solver": "leapfrog"}, {"interface": "xx"}, {"solver": "bdf", "dense": True}):
+    try:
+        F.setup_simulation(0, 1, 0.1, **bad)
+        assert False, bad
+    except ValueError:
+        pass
+
+print("test_solvers: OK")
@@ -0,0 +1,56 @@
+# sweep : mêmes résultats avec 1 et N threads, avec ou sans pool et zone d'allocation,
+# et mêmes résultats que simulate() pour chaque jeu de valeurs de départ
+import FMUSimulator as F
+
+PARAMS = [{"e": 0.5 + 0.05 * k, "h": 1.0 + 0.1 * k} for k in range(8)]
+OUTPUTS = ["time", "h", "v"]
+
+
+def run(**options):
+    return [list(rows) for rows in F.sweep(PARAMS, 0, 2, 0.01, OUTPUTS, **options)]
+
+
+reference = run(workers=1)
+assert len(reference) == len(PARAMS)
+
+# Chaque simulation est celle de setup_simulation() avec les mêmes valeurs,
+# dont l'itération s'arrête avant la ligne du temps de fin
+for params, rows in zip(PARAMS, reference):
+    s = F.setup_simulation(0, 2, 0.01, outputs=OUTPUTS)
+    for name in params:
+        F.change_variable_value(s, name, params[name])
+    expected = [v for row in s for v in row]
+    assert rows[:len(expected)] == expected and len(rows) == len(expected) + 4, params
+default = F.sweep([{}], 0, 2, 0.01, OUTPUTS)[0]
+assert list(default) == list(F.simulate(0, 2, 0.01, outputs=OUTPUTS, layout="rows"))
+
+# Les jeux de valeurs donnent bien des trajectoires différentes
+assert reference[0] != reference[1]
+
+for workers in (2, 4, 16):
+    assert run(workers=workers) == reference, workers
+assert run() == reference
+
+# Les instances réutilisées par le pool et les zones d'allocation ne changent rien
+F.set_pool_size(2)
+assert run(workers=4) == reference
+assert run(workers=4) == reference
+assert F.pool_stats()["hits"] > 0
+F.set_pool_size(0)
+assert run(workers=4, arena=65536) == reference
+assert run(workers=3, solver="dopri5") == run(workers=1, solver="dopri5")
+assert run(workers=3, interface="cs") == run(workers=1, interface="cs")
+
+for bad in ({"arena": 0}, {"arena": -1}, {"arena": bytearray(16)}):
+    try:
+        run(**bad)
+        assert False, bad
+    except ValueError:
+        pass
+try:
+    F.sweep([{"unknown": 1.0}], 0, 1, 0.1)
+    assert False, "unknown variable accepted"
+except ValueError:
+    pass
+
+print("test_sweep: OK")
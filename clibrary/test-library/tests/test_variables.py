@@ -0,0 +1,47 @@
+# Variables du modèle par défaut : noms, valeurs de départ, indices et
+# vérification des valeurs données à change_variable_value
+import FMUSimulator as F
+
+names = F.get_variables_names()
+assert names[0] == "step" and len(names) == F.get_variable_count() + 1
+assert len(F.get_variables_base_values()) == len(names)
+assert len(F.get_variables_description()) == len(names)
+for k, name in enumerate(names):
+    assert F.resolve(name) == k, name
+    assert F.get_variables_names(k) == (name,)
+    assert F.get_variables_names(name) == (name,)
+
+# Autant d'arguments que voulu, chacun vérifié sur le modèle
+everything = tuple(range(len(names))) * 3
+assert F.get_variables_names(*everything) == names * 3
+for bad in (len(names), -1):
+    try:
+        F.get_variables_names(bad)
+        assert False, bad
+    except ValueError:
+        pass
+try:
+    F.get_variables_names("nothing")
+    assert False, "unknown variable accepted"
+except ValueError:
+    pass
+
+h = F.resolve("h")
+base = F.get_variables_base_values("h", "e")
+s = F.setup_simulation(0, 1, 0.1, outputs=["h", "e"])
+assert F.change_variable_value(s, h, 2) is True
+assert F.change_variable_value(s, "e", 0.5) is True
+assert next(s)[1:] == (2.0, 0.5)
+
+# Les valeurs refusées ne changent rien
+for variable, value, error in (("h", "1", TypeError), ("h", None, TypeError), ("h", [1.0], TypeError),
+                               ("step", 1, ValueError), ("nothing", 1, ValueError)):
+    try:
+        F.change_variable_value(s, variable, value)
+        assert False, (variable, value)
+    except error:
+        pass
+assert next(s)[2] == 0.5
+assert F.get_variables_base_values("h", "e") == base
+
+print("test_variables: OK")
@@ -0,0 +1,50 @@
+# set_warm_start_size : une simulation repartie d'un état mis en cache donne
+# les mêmes résultats qu'une initialisation complète
+import FMUSimulator as F
+
+OUTPUTS = ["time", "h", "v"]
+
+
+def run(end=2, **values):
+    s = F.setup_simulation(0, end, 0.01, outputs=OUTPUTS)
+    for name in values:
+        F.change_variable_value(s, name, values[name])
+    rows = list(s)
+    s.close()
+    return rows
+
+
+cold = [run(), run(h=2.0), run(h=2.0, e=0.5)]
+short = run(end=1)
+assert cold[0] != cold[1] and cold[1] != cold[2]
+assert F.warm_start_stats()["size"] == 0
+
+F.set_warm_start_size(2)
+for _ in range(3):
+    assert run() == cold[0]
+    assert run(h=2.0) == cold[1]
+stats = F.warm_start_stats()
+assert stats["size"] == 2 and stats["entries"] == 2, stats
+assert stats["misses"] == 2 and stats["hits"] == 4, stats
+
+# Une troisième entrée remplace la moins récemment utilisée
+assert run(h=2.0, e=0.5) == cold[2]
+assert run() == cold[0]
+stats = F.warm_start_stats()
+assert stats["entries"] == 2 and stats["misses"] == 4, stats
+
+# Même temps de départ mais autre temps de fin : pas de reprise
+assert run(end=1) == short
+assert F.warm_start_stats()["misses"] == 5
+
+# sweep s'en sert aussi, avec les mêmes résultats
+results = F.sweep([{}, {"h": 2.0}] * 4, 0, 2, 0.01, OUTPUTS, workers=2)
+reference = F.sweep([{}, {"h": 2.0}], 0, 2, 0.01, OUTPUTS, workers=1)
+for k, rows in enumerate(results):
+    assert list(rows) == list(reference[k % 2]), k
+
+F.set_warm_start_size(0)
+assert F.warm_start_stats()["entries"] == 0
+assert run() == cold[0]
+
+print("test_warmstart: OK")
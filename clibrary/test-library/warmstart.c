@@ -0,0 +1,229 @@
+/**
+ * @file warmstart.c
+ * @brief Cache of the states of a model right after initialization.
+ *
+ * Simulations with the same start values leave initialization mode in the
+ * same state. The first one stores a snapshot of it, keyed by its start time,
+ * stop time and the values of the variables that can be set before
+ * initialization. The next ones restore the snapshot instead of running
+ * fmi2ExitInitializationMode and the initial event iteration of Model Exchange.
+ *
+ * The key is hashed to find an entry quickly, then compared value by value.
+ * When the cache is full, the least recently used entry is replaced. The
+ * cache is shared by the threads of a sweep.
+ *
+ * Included by main.c, before the models.
+ */
+
+// Snapshot of a simulation after initialization
+typedef struct {
+    uint32_t hash;                   // hash of the key
+    double *key;                     // start time, stop time, then the start values
+    fmi2Byte *snapshot;              // written by writeSnapshot()
+    size_t size;                     // size of the snapshot
+    unsigned long lastUse;           // clock of the cache when last stored or restored
+} WarmStartEntry;
+
+// Structure to hold the snapshots of a model, with their statistics
+typedef struct {
+    int *keyVars;                    // indices of the variables of the key
+    int nKeyVars;                    // number of variables of the key
+    int nKey;                        // number of values of a key
+    WarmStartEntry *entries;         // stored snapshots
+    int count;                       // number of entries
+    int capacity;                    // largest number of entries kept
+    unsigned long clock;             // incremented at each use of an entry
+    size_t hits;                     // initializations restored from a snapshot
+    size_t misses;                   // initializations run while the cache was enabled
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_t mutex;
+    #endif
+} WarmStartCache;
+
+#define WARM_START_KEY_HEADER 2
+
+static void warmStartLock(WarmStartCache *cache) {
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_lock(&cache->mutex, 1);
+    #else
+    (void)cache;
+    #endif
+}
+
+static void warmStartUnlock(WarmStartCache *cache) {
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_unlock(&cache->mutex);
+    #else
+    (void)cache;
+    #endif
+}
+
+/**
+ * @brief Returns whether the value of a variable before initialization changes the initialized state.
+ *
+ * These are the variables that can be set in initialization mode: inputs, and
+ * variables with an exact or approximate start value which are not constant.
+ */
+static int isInitialValue(const ScalarVariable *var) {
+    if (var->type == STRING || var->causality == INDEPENDENT || var->variability == CONSTANT) return 0;
+    return var->causality == INPUT || var->initial != CALCULATED;
+}
+
+/**
+ * @brief Creates an empty cache for a model.
+ *
+ * @return The cache, NULL on allocation failure
+ */
+static WarmStartCache *warmStartNew(const ScalarVariable *variables, int nVariables) {
+    WarmStartCache *cache = (WarmStartCache*)calloc(1, sizeof(WarmStartCache));
+    if (!cache) return NULL;
+    cache->keyVars = (int*)calloc(nVariables + 1, sizeof(int));
+    if (!cache->keyVars) {
+        free(cache);
+        return NULL;
+    }
+    for (int i = 0; i < nVariables; i++) {
+        if (isInitialValue(&variables[i])) cache->keyVars[cache->nKeyVars++] = i;
+    }
+    cache->nKey = WARM_START_KEY_HEADER + cache->nKeyVars;
+    #if MICROPY_PY_THREAD
+    mp_thread_mutex_init(&cache->mutex);
+    #endif
+    return cache;
+}
+
+static void warmStartFreeEntry(WarmStartEntry *entry) {
+    free(entry->key);
+    free(entry->snapshot);
+}
+
+/**
+ * @brief Changes the number of snapshots a cache keeps, dropping the least recently used ones.
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int warmStartResize(WarmStartCache *cache, int capacity) {
+    warmStartLock(cache);
+    while (cache->count > capacity) {
+        int oldest = 0;
+        for (int i = 1; i < cache->count; i++) {
+            if (cache->entries[i].lastUse < cache->entries[oldest].lastUse) oldest = i;
+        }
+        warmStartFreeEntry(&cache->entries[oldest]);
+        cache->entries[oldest] = cache->entries[--cache->count];
+    }
+    WarmStartEntry *entries = (WarmStartEntry*)realloc(cache->entries, (capacity + 1) * sizeof(WarmStartEntry));
+    if (!entries) {
+        warmStartUnlock(cache);
+        return -1;
+    }
+    cache->entries = entries;
+    cache->capacity = capacity;
+    warmStartUnlock(cache);
+    return 0;
+}
+
+/**
+ * @brief Frees a cache and its snapshots.
+ */
+static void warmStartFree(WarmStartCache *cache) {
+    if (!cache) return;
+    for (int i = 0; i < cache->count; i++) {
+        warmStartFreeEntry(&cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache->keyVars);
+    free(cache);
+}
+
+/**
+ * @brief FNV-1a hash of the bytes of a key.
+ */
+static uint32_t warmStartHash(const double *key, int nKey) {
+    const unsigned char *bytes = (const unsigned char*)key;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < nKey * sizeof(double); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Entry with the given key, -1 if there is none. Called with the cache locked.
+static int warmStartFind(const WarmStartCache *cache, uint32_t hash, const double *key) {
+    for (int i = 0; i < cache->count; i++) {
+        const WarmStartEntry *entry = &cache->entries[i];
+        if (entry->hash == hash && memcmp(entry->key, key, cache->nKey * sizeof(double)) == 0) return i;
+    }
+    return -1;
+}
+
+/**
+ * @brief Copies the snapshot stored for a key.
+ *
+ * The snapshot is copied so that another thread may replace the entry while
+ * it is restored.
+ *
+ * @param key Key of cache->nKey values
+ * @param snapshot Set to a copy of the snapshot on a hit, to be freed with free()
+ * @param size Set to the size of the snapshot on a hit
+ * @return 1 on a hit, 0 on a miss or if the copy could not be allocated
+ */
+static int warmStartLookup(WarmStartCache *cache, const double *key, fmi2Byte **snapshot, size_t *size) {
+    uint32_t hash = warmStartHash(key, cache->nKey);
+    int hit = 0;
+    warmStartLock(cache);
+    int i = cache->capacity > 0 ? warmStartFind(cache, hash, key) : -1;
+    if (i >= 0) {
+        WarmStartEntry *entry = &cache->entries[i];
+        *snapshot = (fmi2Byte*)malloc(entry->size);
+        if (*snapshot) {
+            memcpy(*snapshot, entry->snapshot, entry->size);
+            *size = entry->size;
+            entry->lastUse = ++cache->clock;
+            hit = 1;
+        }
+    }
+    if (hit) cache->hits++;
+    else if (cache->capacity > 0) cache->misses++;
+    warmStartUnlock(cache);
+    return hit;
+}
+
+/**
+ * @brief Stores the snapshot of a key, replacing the least recently used entry if the cache is full.
+ *
+ * @param key Key of cache->nKey values, copied
+ * @param snapshot Snapshot allocated with malloc(), owned by the cache from now on
+ * @param size Size of the snapshot
+ */
+static void warmStartStore(WarmStartCache *cache, const double *key, fmi2Byte *snapshot, size_t size) {
+    uint32_t hash = warmStartHash(key, cache->nKey);
+    double *keyCopy = (double*)malloc(cache->nKey * sizeof(double));
+    if (!keyCopy) {
+        free(snapshot);
+        return;
+    }
+    memcpy(keyCopy, key, cache->nKey * sizeof(double));
+    WarmStartEntry entry = {hash, keyCopy, snapshot, size, 0};
+
+    warmStartLock(cache);
+    // Another thread may have stored the same key since the lookup
+    if (cache->capacity == 0 || warmStartFind(cache, hash, key) >= 0) {
+        warmStartUnlock(cache);
+        warmStartFreeEntry(&entry);
+        return;
+    }
+    int slot = cache->count;
+    if (cache->count == cache->capacity) {
+        slot = 0;
+        for (int i = 1; i < cache->count; i++) {
+            if (cache->entries[i].lastUse < cache->entries[slot].lastUse) slot = i;
+        }
+        warmStartFreeEntry(&cache->entries[slot]);
+    } else {
+        cache->count++;
+    }
+    entry.lastUse = ++cache->clock;
+    cache->entries[slot] = entry;
+    warmStartUnlock(cache);
+}
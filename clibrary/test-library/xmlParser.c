@@ -0,0 +1,267 @@
+/**
+ * @file xmlParser.c
+ * @brief Non-validating parser of modelDescription.xml, shared by genModelDescription and load_fmu().
+ *
+ * The document is read in a single pass. The startElement callback is called
+ * for each opening or empty element with its attributes, which point into the
+ * document and are decoded on demand by xmlDecode(). It returns whether the
+ * children of the element matter: the subtrees of the other elements, such as
+ * VendorAnnotations, SourceFiles or the Annotations of a variable, are skipped
+ * whatever their depth and the length of their names.
+ *
+ * Comments, processing instructions, DOCTYPE and CDATA sections are skipped
+ * and text content is ignored: modelDescription.xml only uses attributes.
+ *
+ * Only depends on the C standard library. Included by genModelDescription.c,
+ * compiled for the host, and by fmuLoader.c.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#define XML_MAX_DEPTH 8              // open elements whose children are parsed, deeper ones are skipped
+#define XML_MAX_NAME 64              // longer element names are never known, their subtree is skipped
+#define XML_MAX_ATTRIBUTES 32
+
+// Attribute of an element, the value points into the XML document and is not decoded
+typedef struct {
+    const char *name;
+    size_t nameLen;
+    const char *value;
+    size_t valueLen;
+} XmlAttribute;
+
+typedef struct XmlParser XmlParser;
+
+// Handles an opening or empty element, returns 1 to parse its children and 0 to skip them
+typedef int (*XmlStartElement)(XmlParser *parser, const char *name, const XmlAttribute *attrs, int nAttrs);
+
+// State of the parser
+struct XmlParser {
+    XmlStartElement startElement;
+    void *context;                   // data of the caller, for startElement
+    char path[XML_MAX_DEPTH][XML_MAX_NAME]; // names of the open elements whose children are parsed
+    int depth;                       // number of these elements
+    int line;                        // line being parsed, for the error messages
+    const char *error;               // first error met, NULL if none, also set by startElement
+};
+
+/**
+ * @brief Prepares a parser calling startElement with the given context.
+ */
+static void xmlInit(XmlParser *parser, XmlStartElement startElement, void *context) {
+    memset(parser, 0, sizeof(XmlParser));
+    parser->startElement = startElement;
+    parser->context = context;
+    parser->line = 1;
+}
+
+/**
+ * @brief Returns whether the open elements end with the given names.
+ */
+static int xmlInside(const XmlParser *parser, const char *parent, const char *grandParent) {
+    if (parser->depth < 1 || strcmp(parser->path[parser->depth - 1], parent) != 0) return 0;
+    if (!grandParent) return 1;
+    return parser->depth >= 2 && strcmp(parser->path[parser->depth - 2], grandParent) == 0;
+}
+
+/**
+ * @brief Returns the attribute of the given name, NULL if the element does not have it.
+ */
+static const XmlAttribute *xmlFindAttribute(const XmlAttribute *attrs, int nAttrs, const char *name) {
+    size_t len = strlen(name);
+    for (int i = 0; i < nAttrs; i++) {
+        if (attrs[i].nameLen == len && strncmp(attrs[i].name, name, len) == 0) return &attrs[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Writes the value of an attribute with the XML entities replaced, in UTF-8.
+ *
+ * @param out Buffer of at least attr->valueLen + 1 bytes: an entity is never
+ *        shorter than the character it stands for
+ * @return 0 on success, -1 on an unknown or unterminated entity
+ */
+static int xmlDecode(const XmlAttribute *attr, char *out) {
+    const char *p = attr->value, *end = attr->value + attr->valueLen;
+    while (p < end) {
+        if (*p != '&') {
+            *out++ = *p++;
+            continue;
+        }
+        const char *semicolon = memchr(p, ';', end - p);
+        if (!semicolon) return -1;
+        size_t len = semicolon - p - 1;
+        const char *entity = p + 1;
+        if (len == 3 && strncmp(entity, "amp", 3) == 0) *out++ = '&';
+        else if (len == 2 && strncmp(entity, "lt", 2) == 0) *out++ = '<';
+        else if (len == 2 && strncmp(entity, "gt", 2) == 0) *out++ = '>';
+        else if (len == 4 && strncmp(entity, "quot", 4) == 0) *out++ = '"';
+        else if (len == 4 && strncmp(entity, "apos", 4) == 0) *out++ = '\'';
+        else if (len > 1 && entity[0] == '#') {
+            unsigned long c = entity[1] == 'x' ? strtoul(entity + 2, NULL, 16) : strtoul(entity + 1, NULL, 10);
+            if (c > 0x10FFFF) return -1;
+            if (c < 0x80) {
+                *out++ = (char)c;
+            } else if (c < 0x800) {
+                *out++ = (char)(0xC0 | (c >> 6));
+                *out++ = (char)(0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                *out++ = (char)(0xE0 | (c >> 12));
+                *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                *out++ = (char)(0x80 | (c & 0x3F));
+            } else {
+                *out++ = (char)(0xF0 | (c >> 18));
+                *out++ = (char)(0x80 | ((c >> 12) & 0x3F));
+                *out++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                *out++ = (char)(0x80 | (c & 0x3F));
+            }
+        } else {
+            return -1;
+        }
+        p = semicolon + 1;
+    }
+    *out = '\0';
+    return 0;
+}
+
+/**
+ * @brief Returns the initial attribute of a ScalarVariable, or its default from the FMI 2.0 standard.
+ *
+ * Takes the attribute strings, NULL when missing, so that genModelDescription
+ * and load_fmu() classify the variables alike. Inputs and the independent
+ * variable, which have no initial attribute, are exact like parameters.
+ *
+ * @return "exact", "approx" or "calculated"
+ */
+static const char *xmlVariableInitial(const char *initial, const char *causality, const char *variability) {
+    if (initial) {
+        if (strcmp(initial, "approx") == 0) return "approx";
+        if (strcmp(initial, "calculated") == 0) return "calculated";
+        return "exact";
+    }
+    if (causality) {
+        if (strcmp(causality, "calculatedParameter") == 0) return "calculated";
+        if (strcmp(causality, "parameter") == 0 || strcmp(causality, "input") == 0 ||
+            strcmp(causality, "independent") == 0) return "exact";
+    }
+    // Outputs and local variables, the default causality
+    return variability && strcmp(variability, "constant") == 0 ? "exact" : "calculated";
+}
+
+// Skips white space, counting the lines
+static const char *xmlSkipSpaces(XmlParser *parser, const char *p) {
+    while (*p && strchr(" \t\r\n", *p)) {
+        if (*p == '\n') parser->line++;
+        p++;
+    }
+    return p;
+}
+
+/**
+ * @brief Parses an XML document, calling parser->startElement for each element.
+ *
+ * @return NULL on success, or a description of the first error, also left in parser->error
+ */
+static const char *xmlParse(XmlParser *parser, const char *p) {
+    XmlAttribute attrs[XML_MAX_ATTRIBUTES];
+    int skipped = 0;                 // open elements of the subtree being skipped
+
+    while (*p && !parser->error) {
+        if (*p != '<') {
+            if (*p == '\n') parser->line++;
+            p++;
+            continue;
+        }
+        if (strncmp(p, "<!", 2) == 0 || strncmp(p, "<?", 2) == 0) {
+            const char *end = strncmp(p, "<!--", 4) == 0 ? "-->" :
+                              strncmp(p, "<?", 2) == 0 ? "?>" :
+                              strncmp(p, "<![CDATA[", 9) == 0 ? "]]>" : ">";
+            const char *q = strstr(p, end);
+            if (!q) return parser->error = "Unterminated markup in modelDescription.xml";
+            for (; p < q; p++) {
+                if (*p == '\n') parser->line++;
+            }
+            p = q + strlen(end);
+            continue;
+        }
+
+        int closing = p[1] == '/';
+        p += closing ? 2 : 1;
+        const char *nameBegin = p;
+        while (*p && !strchr(" \t\r\n/>", *p)) p++;
+        size_t nameLen = p - nameBegin;
+        if (nameLen == 0) return parser->error = "Invalid element name in modelDescription.xml";
+
+        if (closing) {
+            if (skipped > 0) {
+                skipped--;
+            } else if (parser->depth == 0 || strncmp(parser->path[parser->depth - 1], nameBegin, nameLen) != 0 ||
+                       parser->path[parser->depth - 1][nameLen] != '\0') {
+                return parser->error = "Mismatched element in modelDescription.xml";
+            } else {
+                parser->depth--;
+            }
+            p = strchr(p, '>');
+            if (!p) return parser->error = "Unterminated element in modelDescription.xml";
+            p++;
+            continue;
+        }
+
+        // Attributes, scanned in skipped elements too since their values may hold '>'
+        int nAttrs = 0;
+        for (;;) {
+            p = xmlSkipSpaces(parser, p);
+            if (*p == '/' || *p == '>' || *p == '\0') break;
+            const char *attrName = p;
+            while (*p && !strchr(" \t\r\n=", *p)) p++;
+            size_t attrLen = p - attrName;
+            p = xmlSkipSpaces(parser, p);
+            if (*p != '=') return parser->error = "Attribute without value in modelDescription.xml";
+            p = xmlSkipSpaces(parser, p + 1);
+            char quote = *p;
+            if (quote != '"' && quote != '\'') return parser->error = "Unquoted attribute value in modelDescription.xml";
+            const char *valueBegin = ++p;
+            while (*p && *p != quote) {
+                if (*p == '\n') parser->line++;
+                p++;
+            }
+            if (!*p) return parser->error = "Unterminated attribute value in modelDescription.xml";
+            if (skipped == 0) {
+                if (nAttrs == XML_MAX_ATTRIBUTES) return parser->error = "Too many attributes in modelDescription.xml";
+                attrs[nAttrs].name = attrName;
+                attrs[nAttrs].nameLen = attrLen;
+                attrs[nAttrs].value = valueBegin;
+                attrs[nAttrs].valueLen = p - valueBegin;
+                nAttrs++;
+            }
+            p++;
+        }
+        int empty = *p == '/';
+        p = strchr(p, '>');
+        if (!p) return parser->error = "Unterminated element in modelDescription.xml";
+        p++;
+
+        if (skipped > 0) {
+            if (!empty) skipped++;
+            continue;
+        }
+
+        // Known elements have short names and are not nested deeply
+        int parse = 0;
+        if (nameLen < XML_MAX_NAME) {
+            char name[XML_MAX_NAME];
+            memcpy(name, nameBegin, nameLen);
+            name[nameLen] = '\0';
+            parse = parser->startElement(parser, name, attrs, nAttrs);
+            if (!empty && parse && parser->depth < XML_MAX_DEPTH) {
+                strcpy(parser->path[parser->depth++], name);
+                continue;
+            }
+        }
+        if (!empty) skipped = 1;
+    }
+    if (parser->error) return parser->error;
+    if (parser->depth != 0 || skipped != 0) return parser->error = "Unexpected end of modelDescription.xml";
+    return NULL;
+}